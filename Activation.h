@@ -0,0 +1,72 @@
+#ifndef ACTIVATION_H
+#define ACTIVATION_H
+
+#include <cmath>
+
+// Element-wise function applied to a layer's pre-activation
+enum class Activation {
+    Sigmoid,
+    Linear,
+    ReLU,
+    Tanh,
+    LeakyReLU
+};
+
+// Activation policies. Each one provides the function itself and its
+// derivative expressed through the function's output y, which is what the
+// backward pass has at hand. The kernels in DenseLayer are templates over these
+// types, so the per-element calls are resolved and inlined at compile time.
+struct SigmoidActivation {
+    static double forward(double x) { return 1.0 / (1.0 + std::exp(-x)); }
+    static double derivative(double y) { return y * (1.0 - y); }
+};
+
+struct LinearActivation {
+    static double forward(double x) { return x; }
+    static double derivative(double) { return 1.0; }
+};
+
+struct ReLUActivation {
+    static double forward(double x) { return x > 0.0 ? x : 0.0; }
+    static double derivative(double y) { return y > 0.0 ? 1.0 : 0.0; }
+};
+
+struct TanhActivation {
+    static double forward(double x) { return std::tanh(x); }
+    static double derivative(double y) { return 1.0 - y * y; }
+};
+
+struct LeakyReLUActivation {
+    static constexpr double slope = 0.01;
+    static double forward(double x) { return x > 0.0 ? x : slope * x; }
+    static double derivative(double y) { return y > 0.0 ? 1.0 : slope; }
+};
+
+/**
+ * @brief Runs Kernel<Policy>::run(args...) with the policy matching the enum value.
+ *
+ * This is the only place where the runtime choice of a layer is mapped to a
+ * policy type; it happens once per kernel call, never per element.
+ */
+template <template <typename> class Kernel, typename... Args>
+void dispatchActivation(Activation activation, Args&&... args) {
+    switch (activation) {
+    case Activation::Sigmoid:
+        Kernel<SigmoidActivation>::run(args...);
+        break;
+    case Activation::Linear:
+        Kernel<LinearActivation>::run(args...);
+        break;
+    case Activation::ReLU:
+        Kernel<ReLUActivation>::run(args...);
+        break;
+    case Activation::Tanh:
+        Kernel<TanhActivation>::run(args...);
+        break;
+    case Activation::LeakyReLU:
+        Kernel<LeakyReLUActivation>::run(args...);
+        break;
+    }
+}
+
+#endif // ACTIVATION_H
@@ -0,0 +1,132 @@
+#include "BatchLoader.h"
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+namespace {
+
+const std::size_t bufferAlignment = 64;
+
+} // namespace
+
+// Constructor allocating the batch buffers and starting the loader thread. Rows are padded
+// to a multiple of eight doubles so every row starts on a 64-byte boundary.
+BatchLoader::BatchLoader(const std::vector<std::vector<double>>& inputs, const std::vector<int>& labels, int batchSize)
+    : m_inputs(inputs), m_labels(labels), m_batchSize(batchSize),
+    m_rowSize(inputs.empty() ? 0 : static_cast<int>(inputs.front().size())),
+    m_rowStride((m_rowSize + 7) & ~7),
+    m_numBatches(0), m_nextFill(0), m_nextConsume(0), m_holding(-1), m_generation(0), m_stop(false) {
+    for (Slot& slot : m_slots) {
+        std::size_t bytes = sizeof(double) * static_cast<std::size_t>(m_rowStride) * std::max(batchSize, 1);
+        slot.data = static_cast<double*>(::operator new[](bytes, std::align_val_t(bufferAlignment)));
+        slot.rows.resize(batchSize);
+        slot.labels.resize(batchSize);
+        slot.indices.reserve(batchSize);
+        for (int b = 0; b < batchSize; ++b) {
+            slot.rows[b] = slot.data + static_cast<std::size_t>(b) * m_rowStride;
+        }
+    }
+    m_thread = std::thread(&BatchLoader::run, this);
+}
+
+// Destructor stopping the loader thread and releasing the buffers
+BatchLoader::~BatchLoader() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_freed.notify_all();
+    m_thread.join();
+    for (Slot& slot : m_slots) {
+        ::operator delete[](slot.data, std::align_val_t(bufferAlignment));
+    }
+}
+
+// Function to start loading the batches of a new order, beginning with firstBatch.
+// Batches of a previous epoch that have not been consumed are dropped.
+void BatchLoader::startEpoch(const std::vector<int>& order, int firstBatch) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        ++m_generation;
+        m_order = order;
+        m_numBatches = (static_cast<int>(m_order.size()) + m_batchSize - 1) / m_batchSize;
+        m_nextFill = firstBatch;
+        m_nextConsume = firstBatch;
+        m_holding = -1;
+        for (Slot& slot : m_slots) {
+            slot.ready = false;
+            slot.batch = -1;
+        }
+    }
+    m_freed.notify_all();
+}
+
+// Function to get the next batch of the epoch, waiting for the loader if it is not ready yet.
+// Returns false once every batch of the epoch has been handed out.
+bool BatchLoader::next(Batch& batch) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    // The previous batch is done; its slot can be refilled
+    if (m_holding >= 0) {
+        m_slots[m_holding].ready = false;
+        m_holding = -1;
+        m_freed.notify_all();
+    }
+    if (m_nextConsume >= m_numBatches) {
+        return false;
+    }
+    const int wanted = m_nextConsume;
+    Slot& slot = m_slots[wanted % slotCount];
+    m_filled.wait(lock, [&] { return slot.ready && slot.batch == wanted; });
+    m_holding = wanted % slotCount;
+    ++m_nextConsume;
+
+    batch.inputs = slot.rows.data();
+    batch.labels = slot.labels.data();
+    batch.indices = slot.indices.data();
+    batch.count = slot.count;
+    return true;
+}
+
+// Thread body: fill free slots with the next batches of the current order
+void BatchLoader::run() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (;;) {
+        m_freed.wait(lock, [this] {
+            if (m_stop) {
+                return true;
+            }
+            int slot = m_nextFill % slotCount;
+            return m_nextFill < m_numBatches && !m_slots[slot].ready && m_holding != slot;
+        });
+        if (m_stop) {
+            break;
+        }
+        const int batchNumber = m_nextFill++;
+        const unsigned generation = m_generation;
+        Slot& slot = m_slots[batchNumber % slotCount];
+        int start = batchNumber * m_batchSize;
+        int end = std::min(start + m_batchSize, static_cast<int>(m_order.size()));
+        slot.indices.assign(m_order.begin() + start, m_order.begin() + end);
+        lock.unlock();
+
+        // Visit the rows in memory order and pack them next to each other
+        std::sort(slot.indices.begin(), slot.indices.end());
+        const int count = end - start;
+        for (int b = 0; b < count; ++b) {
+            int index = slot.indices[b];
+            std::memcpy(slot.data + static_cast<std::size_t>(b) * m_rowStride, m_inputs[index].data(),
+                        sizeof(double) * m_rowSize);
+            slot.labels[b] = m_labels[index];
+        }
+
+        lock.lock();
+        // A restarted epoch invalidates what was just loaded
+        if (generation == m_generation) {
+            slot.count = count;
+            slot.batch = batchNumber;
+            slot.ready = true;
+            m_filled.notify_all();
+        }
+    }
+}
@@ -0,0 +1,76 @@
+#ifndef BATCHLOADER_H
+#define BATCHLOADER_H
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Gathers shuffled mini-batches on a background thread.
+ *
+ * Every sample of a dataset is a separately allocated vector, so walking a
+ * shuffled index list stalls on a cache miss per row. The loader copies the
+ * rows of the next batch into a contiguous, 64-byte aligned buffer while the
+ * caller computes on the current one (double buffering). Within a batch the
+ * indices are visited in ascending order, which turns the random walk into a
+ * forward sweep; the order of samples inside a batch does not change its mean
+ * gradient.
+ *
+ * Usage: startEpoch() with the epoch's shuffled order, then next() until it
+ * returns false. A batch stays valid until the following next() or startEpoch().
+ */
+class BatchLoader {
+public:
+    struct Batch {
+        const double* const* inputs;
+        const int* labels;
+        const int* indices; // dataset index of every row, ascending
+        int count;
+    };
+
+    BatchLoader(const std::vector<std::vector<double>>& inputs, const std::vector<int>& labels, int batchSize);
+    ~BatchLoader();
+
+    BatchLoader(const BatchLoader&) = delete;
+    BatchLoader& operator=(const BatchLoader&) = delete;
+
+    void startEpoch(const std::vector<int>& order, int firstBatch = 0);
+    bool next(Batch& batch);
+
+private:
+    static const int slotCount = 2;
+
+    struct Slot {
+        double* data = nullptr;
+        std::vector<const double*> rows;
+        std::vector<int> labels;
+        std::vector<int> indices;
+        int count = 0;
+        int batch = -1;
+        bool ready = false;
+    };
+
+    const std::vector<std::vector<double>>& m_inputs;
+    const std::vector<int>& m_labels;
+    const int m_batchSize;
+    const int m_rowSize;
+    const int m_rowStride;
+    Slot m_slots[slotCount];
+
+    std::mutex m_mutex;
+    std::condition_variable m_filled;
+    std::condition_variable m_freed;
+    std::vector<int> m_order;
+    int m_numBatches;
+    int m_nextFill;
+    int m_nextConsume;
+    int m_holding;
+    unsigned m_generation;
+    bool m_stop;
+    std::thread m_thread;
+
+    void run();
+};
+
+#endif // BATCHLOADER_H
@@ -0,0 +1,77 @@
+#ifndef BINARYIO_H
+#define BINARYIO_H
+
+#include "Matrix.h"
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Helpers for the binary checkpoint format. Values are written in the host's
+// native byte order; checkpoints are meant to be resumed on the same kind of machine.
+
+template <typename T>
+void writeValue(std::ostream& stream, const T& value) {
+    stream.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+T readValue(std::istream& stream) {
+    T value;
+    if (!stream.read(reinterpret_cast<char*>(&value), sizeof(T))) {
+        throw std::runtime_error("Unexpected end of checkpoint data");
+    }
+    return value;
+}
+
+template <typename T>
+void writeVector(std::ostream& stream, const std::vector<T>& values) {
+    writeValue<long long>(stream, static_cast<long long>(values.size()));
+    if (!values.empty()) {
+        stream.write(reinterpret_cast<const char*>(values.data()), sizeof(T) * values.size());
+    }
+}
+
+template <typename T>
+std::vector<T> readVector(std::istream& stream) {
+    long long size = readValue<long long>(stream);
+    if (size < 0) {
+        throw std::runtime_error("Corrupt checkpoint data");
+    }
+    std::vector<T> values(static_cast<size_t>(size));
+    if (size > 0 && !stream.read(reinterpret_cast<char*>(values.data()), sizeof(T) * values.size())) {
+        throw std::runtime_error("Unexpected end of checkpoint data");
+    }
+    return values;
+}
+
+inline void writeString(std::ostream& stream, const std::string& value) {
+    writeVector(stream, std::vector<char>(value.begin(), value.end()));
+}
+
+inline std::string readString(std::istream& stream) {
+    std::vector<char> characters = readVector<char>(stream);
+    return std::string(characters.begin(), characters.end());
+}
+
+inline void writeMatrix(std::ostream& stream, const MyMatrix& matrix) {
+    writeValue<int>(stream, matrix.rows());
+    writeValue<int>(stream, matrix.columns());
+    stream.write(reinterpret_cast<const char*>(matrix.data()), sizeof(double) * matrix.rows() * matrix.columns());
+}
+
+inline MyMatrix readMatrix(std::istream& stream) {
+    int rows = readValue<int>(stream);
+    int cols = readValue<int>(stream);
+    if (rows < 0 || cols < 0) {
+        throw std::runtime_error("Corrupt checkpoint data");
+    }
+    MyMatrix matrix(rows, cols);
+    if (!stream.read(reinterpret_cast<char*>(matrix.data()), sizeof(double) * rows * cols)) {
+        throw std::runtime_error("Unexpected end of checkpoint data");
+    }
+    return matrix;
+}
+
+#endif // BINARYIO_H
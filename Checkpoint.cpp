@@ -0,0 +1,218 @@
+#include "Checkpoint.h"
+#include "BinaryIO.h"
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+// Function to write a layer stack: count, then weights, biases and activation of every layer
+void writeLayers(std::ostream& stream, const std::vector<DenseLayer>& layers) {
+    writeValue<int>(stream, static_cast<int>(layers.size()));
+    for (const DenseLayer& layer : layers) {
+        writeMatrix(stream, layer.weights());
+        writeMatrix(stream, layer.biases());
+        writeValue<int>(stream, static_cast<int>(layer.activation()));
+    }
+}
+
+// Function to read a layer stack written by writeLayers
+std::vector<DenseLayer> readLayers(std::istream& stream) {
+    int count = readValue<int>(stream);
+    if (count < 0) {
+        throw std::runtime_error("Corrupt checkpoint data");
+    }
+    std::vector<DenseLayer> layers;
+    for (int l = 0; l < count; ++l) {
+        MyMatrix weights = readMatrix(stream);
+        MyMatrix biases = readMatrix(stream);
+        int activation = readValue<int>(stream);
+        // Every layer has to read exactly the outputs of the one before it
+        bool chained = layers.empty() || weights.columns() == layers.back().outputSize();
+        if (weights.rows() == 0 || weights.columns() == 0 || biases.rows() != weights.rows() ||
+            biases.columns() != 1 || !chained || activation < 0 ||
+            activation > static_cast<int>(Activation::LeakyReLU)) {
+            throw std::runtime_error("Corrupt checkpoint data: inconsistent layer sizes");
+        }
+        layers.emplace_back(weights, biases, static_cast<Activation>(activation));
+    }
+    return layers;
+}
+
+// Function to write the progress of a training run
+void writeTrainingState(std::ostream& stream, const TrainingState& state) {
+    writeValue<bool>(stream, state.active);
+    writeValue<int>(stream, state.epoch);
+    writeValue<int>(stream, state.nextBatch);
+    writeValue<int>(stream, state.batchSize);
+    writeValue<int>(stream, state.numSamples);
+    writeValue<double>(stream, state.epochError);
+    writeValue<long long>(stream, state.samplesSeen);
+    std::ostringstream rng;
+    rng << state.rng;
+    writeString(stream, rng.str());
+    writeVector(stream, state.trainIndices);
+    writeVector(stream, state.validationIndices);
+    writeValue<double>(stream, state.bestAccuracy);
+    writeLayers(stream, state.bestLayers);
+    writeValue<int>(stream, state.epochsWithoutImprovement);
+    writeVector(stream, state.sampleLoss);
+    writeVector(stream, state.epochOrder);
+}
+
+// Function to read the progress of a training run written by writeTrainingState
+void readTrainingState(std::istream& stream, TrainingState& state) {
+    state.active = readValue<bool>(stream);
+    state.epoch = readValue<int>(stream);
+    state.nextBatch = readValue<int>(stream);
+    state.batchSize = readValue<int>(stream);
+    state.numSamples = readValue<int>(stream);
+    state.epochError = readValue<double>(stream);
+    state.samplesSeen = readValue<long long>(stream);
+    std::istringstream rng(readString(stream));
+    rng >> state.rng;
+    if (!rng) {
+        throw std::runtime_error("Corrupt random generator state in checkpoint");
+    }
+    state.trainIndices = readVector<int>(stream);
+    state.validationIndices = readVector<int>(stream);
+    state.bestAccuracy = readValue<double>(stream);
+    state.bestLayers = readLayers(stream);
+    state.epochsWithoutImprovement = readValue<int>(stream);
+    state.sampleLoss = readVector<double>(stream);
+    state.epochOrder = readVector<int>(stream);
+}
+
+// Function to check whether two layer stacks have the same number of layers with the same sizes
+bool sameLayerShapes(const std::vector<DenseLayer>& a, const std::vector<DenseLayer>& b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t l = 0; l < a.size(); ++l) {
+        if (a[l].inputSize() != b[l].inputSize() || a[l].outputSize() != b[l].outputSize()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Checks that a restored training run fits the restored network and its own dataset size.
+ *
+ * An inactive state is replaced by the next train() call and is not checked.
+ * For an active one, the train and validation indices have to be a permutation
+ * of 0..numSamples-1, the epoch order and the per-sample losses have to index
+ * that dataset, the next batch has to lie inside the epoch and the best layers
+ * have to have the network's shape.
+ *
+ * @param state The TrainingState read by readTrainingState().
+ * @param layers The layers read from the same checkpoint.
+ * @throws std::runtime_error On any mismatch.
+ */
+void validateTrainingState(const TrainingState& state, const std::vector<DenseLayer>& layers) {
+    if (!state.active) {
+        return;
+    }
+    const int numSamples = state.numSamples;
+    if (state.epoch < 0 || state.batchSize < 1 || numSamples < 0 || state.nextBatch < 0 ||
+        state.trainIndices.size() + state.validationIndices.size() != static_cast<size_t>(numSamples)) {
+        throw std::runtime_error("Corrupt checkpoint data: inconsistent training progress");
+    }
+    std::vector<char> seen(numSamples, 0);
+    for (const std::vector<int>* indices : { &state.trainIndices, &state.validationIndices }) {
+        for (int index : *indices) {
+            if (index < 0 || index >= numSamples || seen[index]) {
+                throw std::runtime_error("Corrupt checkpoint data: invalid data split");
+            }
+            seen[index] = 1;
+        }
+    }
+    for (int index : state.epochOrder) {
+        if (index < 0 || index >= numSamples) {
+            throw std::runtime_error("Corrupt checkpoint data: invalid epoch order");
+        }
+    }
+    const size_t orderSize = state.epochOrder.empty() ? state.trainIndices.size() : state.epochOrder.size();
+    const size_t numBatches = (orderSize + state.batchSize - 1) / state.batchSize;
+    if (static_cast<size_t>(state.nextBatch) > numBatches ||
+        (!state.sampleLoss.empty() && state.sampleLoss.size() != static_cast<size_t>(numSamples)) ||
+        (!state.bestLayers.empty() && !sameLayerShapes(state.bestLayers, layers))) {
+        throw std::runtime_error("Corrupt checkpoint data: training state does not match the network");
+    }
+}
+
+// Constructor to start the background writer thread
+CheckpointWriter::CheckpointWriter()
+    : m_pending(false), m_busy(false), m_stop(false), m_thread(&CheckpointWriter::run, this) {}
+
+// Destructor writing any pending checkpoint before the thread exits
+CheckpointWriter::~CheckpointWriter() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_wake.notify_one();
+    m_thread.join();
+}
+
+// Function to queue a checkpoint for writing; replaces one that has not been started yet
+void CheckpointWriter::submit(const std::string& path, std::string data) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_path = path;
+        m_data = std::move(data);
+        m_pending = true;
+    }
+    m_wake.notify_one();
+}
+
+// Function to wait until every submitted checkpoint is on disk
+void CheckpointWriter::flush() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_idle.wait(lock, [this] { return !m_pending && !m_busy; });
+}
+
+// Function to get the error of the last failed write (empty if it succeeded)
+std::string CheckpointWriter::lastError() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_lastError;
+}
+
+// Thread body: write the newest pending checkpoint until asked to stop
+void CheckpointWriter::run() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (;;) {
+        m_wake.wait(lock, [this] { return m_pending || m_stop; });
+        if (!m_pending) {
+            break;
+        }
+        std::string path = std::move(m_path);
+        std::string data = std::move(m_data);
+        m_pending = false;
+        m_busy = true;
+        lock.unlock();
+
+        std::string error;
+        std::string temporary = path + ".tmp";
+        {
+            // Close explicitly: the last buffered block is only written, and can only fail, here
+            std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+            file.write(data.data(), static_cast<std::streamsize>(data.size()));
+            file.close();
+            if (!file) {
+                error = "Error writing checkpoint " + temporary;
+            }
+        }
+        if (error.empty()) {
+            std::error_code code;
+            std::filesystem::rename(temporary, path, code);
+            if (code) {
+                error = "Error renaming checkpoint to " + path + ": " + code.message();
+            }
+        }
+
+        lock.lock();
+        m_lastError = error;
+        m_busy = false;
+        m_idle.notify_all();
+    }
+    m_idle.notify_all();
+}
@@ -0,0 +1,77 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include "Layer.h"
+#include <condition_variable>
+#include <iosfwd>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Leading bytes ("NNCK") and format version of a checkpoint file
+const unsigned checkpointMagic = 0x4b434e4e;
+const int checkpointVersion = 3;
+
+// Everything NeuralNetwork::train() needs to continue a run exactly where it
+// stopped: position in the run, shuffle RNG, data split, the current epoch's
+// shuffled order, the early-stopping bookkeeping and, for prioritized sampling,
+// the per-sample loss index and the sampled order of the current epoch.
+struct TrainingState {
+    bool active = false;
+    int epoch = 0;
+    int nextBatch = 0;
+    int batchSize = 0;
+    int numSamples = 0;
+    double epochError = 0.0;
+    long long samplesSeen = 0;
+    std::mt19937 rng;
+    std::vector<int> trainIndices;
+    std::vector<int> validationIndices;
+    double bestAccuracy = -1.0;
+    std::vector<DenseLayer> bestLayers;
+    int epochsWithoutImprovement = 0;
+    std::vector<double> sampleLoss;
+    std::vector<int> epochOrder;
+};
+
+void writeLayers(std::ostream& stream, const std::vector<DenseLayer>& layers);
+std::vector<DenseLayer> readLayers(std::istream& stream);
+void writeTrainingState(std::ostream& stream, const TrainingState& state);
+void readTrainingState(std::istream& stream, TrainingState& state);
+bool sameLayerShapes(const std::vector<DenseLayer>& a, const std::vector<DenseLayer>& b);
+void validateTrainingState(const TrainingState& state, const std::vector<DenseLayer>& layers);
+
+// Writes checkpoint files on a background thread. The training thread only
+// serializes into memory and hands the bytes over; if a newer checkpoint arrives
+// before the previous one was written, only the newer one is kept. Files are
+// written to a temporary name and renamed, so a crash never leaves a torn file.
+class CheckpointWriter {
+public:
+    CheckpointWriter();
+    ~CheckpointWriter();
+
+    CheckpointWriter(const CheckpointWriter&) = delete;
+    CheckpointWriter& operator=(const CheckpointWriter&) = delete;
+
+    void submit(const std::string& path, std::string data);
+    void flush();
+    std::string lastError();
+
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_idle;
+    std::string m_path;
+    std::string m_data;
+    std::string m_lastError;
+    bool m_pending;
+    bool m_busy;
+    bool m_stop;
+    std::thread m_thread;
+
+    void run();
+};
+
+#endif // CHECKPOINT_H
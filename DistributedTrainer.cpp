@@ -0,0 +1,184 @@
+#include "DistributedTrainer.h"
+#include <algorithm>
+#include <cstdio>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Constructor taking this process's network and its connection to the ring
+DistributedTrainer::DistributedTrainer(NeuralNetwork& network, RingAllreduce& communicator)
+    : m_network(network), m_communicator(communicator) {}
+
+/**
+ * @brief Forks a ring of worker processes on this machine and waits for all of them.
+ *
+ * Every child joins the ring on 127.0.0.1 and runs body with its communicator.
+ * Call it before the parent starts any threads (including an OpenMP team);
+ * only the calling thread survives a fork.
+ *
+ * @param workers The number of processes in the ring.
+ * @param basePort Worker r listens on basePort + r.
+ * @param body The work of one rank.
+ * @throws std::runtime_error If a worker cannot be started or fails.
+ */
+void DistributedTrainer::launchLocal(int workers, int basePort, const std::function<void(RingAllreduce&)>& body) {
+    const std::vector<std::string> hosts(std::max(workers, 1), "127.0.0.1");
+    std::fflush(nullptr);
+    std::vector<pid_t> children;
+    for (int rank = 0; rank < static_cast<int>(hosts.size()); ++rank) {
+        pid_t pid = fork();
+        if (pid < 0) {
+            // The started workers would wait for the missing rank forever
+            for (pid_t child : children) {
+                kill(child, SIGKILL);
+                waitpid(child, nullptr, 0);
+            }
+            throw std::runtime_error("Cannot start distributed training worker " + std::to_string(rank));
+        }
+        if (pid == 0) {
+            int status = 0;
+            try {
+                RingAllreduce communicator(rank, hosts, basePort);
+                body(communicator);
+            } catch (const std::exception& e) {
+                std::fprintf(stderr, "Worker %d failed: %s\n", rank, e.what());
+                status = 1;
+            }
+            std::fflush(nullptr);
+            _exit(status);
+        }
+        children.push_back(pid);
+    }
+
+    bool failed = false;
+    for (pid_t child : children) {
+        int status = 0;
+        if (waitpid(child, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            failed = true;
+        }
+    }
+    if (failed) {
+        throw std::runtime_error("A distributed training worker failed");
+    }
+}
+
+/**
+ * @brief Trains this rank's network data-parallel with the other ranks of the ring.
+ *
+ * All ranks must call it with the same dataset and arguments. The samples are
+ * dealt to the ranks after one shared shuffle; a mini-batch of batchSize samples
+ * is made of batchSize / worldSize samples from every shard, and the epoch ends
+ * when the largest shard has been visited once.
+ *
+ * @param inputs A vector of input vectors, each representing the features of a training example.
+ * @param labels The target label of every input vector.
+ * @param epochs The number of passes over the training data.
+ * @param batchSize The number of training examples in each mini-batch, summed over all ranks.
+ * @return The mean training loss over all ranks in the last epoch.
+ * @throws std::invalid_argument If there are fewer samples than ranks or the batch size is not positive.
+ */
+double DistributedTrainer::train(const std::vector<std::vector<double>>& inputs, const std::vector<int>& labels,
+                                 int epochs, int batchSize) {
+    const int worldSize = m_communicator.worldSize();
+    const int rank = m_communicator.rank();
+    const int numSamples = static_cast<int>(inputs.size());
+    if (numSamples < worldSize || batchSize < 1) {
+        throw std::invalid_argument("DistributedTrainer needs a positive batch size and at least one sample per rank");
+    }
+
+    // Start every rank from rank 0's weights and shuffle seed
+    std::vector<double> parameters(m_network.parameterCount());
+    m_network.getParameters(parameters.data());
+    m_communicator.broadcast(parameters.data(), parameters.size());
+    m_network.setParameters(parameters.data());
+    double seedValue = static_cast<double>(std::random_device()());
+    m_communicator.broadcast(&seedValue, 1);
+    std::mt19937 g(static_cast<unsigned>(seedValue));
+
+    // Deal the shuffled samples to the ranks; shard sizes differ by at most one
+    std::vector<int> order(numSamples);
+    std::iota(order.begin(), order.end(), 0);
+    std::shuffle(order.begin(), order.end(), g);
+    std::vector<int> shard;
+    for (int i = rank; i < numSamples; i += worldSize) {
+        shard.push_back(order[i]);
+    }
+    std::mt19937 shardGenerator(g() + rank);
+    const int shardSize = static_cast<int>(shard.size());
+    const int localBatch = std::max(1, (batchSize + worldSize - 1) / worldSize);
+    const int largestShard = (numSamples + worldSize - 1) / worldSize;
+    const int steps = (largestShard + localBatch - 1) / localBatch;
+
+    m_buffer.assign(parameters.size() + 2, 0.0);
+    std::vector<const double*> batchInputs(localBatch);
+    std::vector<int> batchLabels(localBatch);
+    double error = 0.0;
+
+    for (int epoch = 0; epoch < epochs; ++epoch) {
+        std::shuffle(shard.begin(), shard.end(), shardGenerator);
+        error = 0.0;
+        for (int step = 0; step < steps; ++step) {
+            int start = step * localBatch;
+            int end = std::min(start + localBatch, shardSize);
+            int count = std::max(0, end - start);
+            for (int i = start; i < end; ++i) {
+                batchInputs[i - start] = inputs[shard[i]].data();
+                batchLabels[i - start] = labels[shard[i]];
+            }
+            double loss = count > 0 ? m_network.computeGradients(batchInputs.data(), batchLabels.data(), count) : 0.0;
+            error += synchronizeGradients(count, loss);
+        }
+
+        error /= numSamples;
+        m_network.publishSnapshot();
+        emit epochCompleted(epoch, error);
+        emit trainingProgress(QString("Epoch %1 completed on rank %2 of %3. Error: %4")
+                                  .arg(epoch).arg(rank).arg(worldSize).arg(error));
+    }
+    return error;
+}
+
+// Function to replace the local mean gradient by the mean over all ranks' samples and apply it.
+// The gradients travel weighted by their sample counts, with the counts and losses appended,
+// so one allreduce carries everything. Returns the summed loss of the batch over all ranks.
+double DistributedTrainer::synchronizeGradients(int count, double loss) {
+    const int numLayers = m_network.getLayerCount();
+    double* out = m_buffer.data();
+    for (int l = 0; l < numLayers; ++l) {
+        const MyMatrix* grads[] = { &m_network.getWeightGradient(l), &m_network.getBiasGradient(l) };
+        for (const MyMatrix* grad : grads) {
+            const int size = grad->rows() * grad->columns();
+            for (int i = 0; i < size; ++i) {
+                out[i] = count > 0 ? grad->data()[i] * count : 0.0;
+            }
+            out += size;
+        }
+    }
+    out[0] = count;
+    out[1] = loss;
+
+    m_communicator.allreduce(m_buffer.data(), m_buffer.size());
+
+    const double total = out[0];
+    const double scale = 1.0 / total;
+    const double* in = m_buffer.data();
+    double squaredNorm = 0.0;
+    for (int l = 0; l < numLayers; ++l) {
+        MyMatrix* grads[] = { &m_network.getWeightGradient(l), &m_network.getBiasGradient(l) };
+        for (MyMatrix* grad : grads) {
+            const int size = grad->rows() * grad->columns();
+            for (int i = 0; i < size; ++i) {
+                double value = in[i] * scale;
+                grad->data()[i] = value;
+                squaredNorm += value * value;
+            }
+            in += size;
+        }
+    }
+    m_network.applyGradients(squaredNorm);
+    return out[1];
+}
@@ -0,0 +1,45 @@
+#ifndef DISTRIBUTEDTRAINER_H
+#define DISTRIBUTEDTRAINER_H
+
+#include "Neuronal_Network.h"
+#include "RingAllreduce.h"
+#include <QObject>
+#include <functional>
+#include <vector>
+
+// Data-parallel training across worker processes. Every process runs one
+// DistributedTrainer with its own network and a RingAllreduce that connects it
+// to the others. All ranks start from rank 0's weights and a shuffle seed it
+// chose; each rank trains on its own shard of the samples, and after every
+// mini-batch the gradients are summed with one ring allreduce, so every rank
+// applies the same optimizer step and the networks stay identical.
+//
+// launchLocal() forks the workers of a ring on this machine. For other setups,
+// start one process per rank with NN_RANK, NN_WORLD_SIZE, NN_PORT and NN_HOSTS
+// set and use RingAllreduce::fromEnvironment(). Like MultiModelTrainer, the
+// train()-level options of the network (validation split, early stopping,
+// budgets, checkpoints) are not used.
+class DistributedTrainer : public QObject {
+    Q_OBJECT
+
+public:
+    DistributedTrainer(NeuralNetwork& network, RingAllreduce& communicator);
+
+    static void launchLocal(int workers, int basePort, const std::function<void(RingAllreduce&)>& body);
+
+    double train(const std::vector<std::vector<double>>& inputs, const std::vector<int>& labels, int epochs,
+                 int batchSize);
+
+signals:
+    void trainingProgress(QString message);
+    void epochCompleted(int epoch, double error);
+
+private:
+    NeuralNetwork& m_network;
+    RingAllreduce& m_communicator;
+    std::vector<double> m_buffer;
+
+    double synchronizeGradients(int count, double loss);
+};
+
+#endif // DISTRIBUTEDTRAINER_H
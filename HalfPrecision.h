@@ -0,0 +1,121 @@
+#ifndef HALFPRECISION_H
+#define HALFPRECISION_H
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__F16C__) || (defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)))
+// The fp16 layer kernels have an AVX/F16C variant; without -mf16c it is selected at runtime
+#define NN_F16C_KERNELS 1
+#include <immintrin.h>
+#endif
+
+// Storage format of the weight copies and activations used by the forward pass.
+// Double keeps everything in full precision; the 16-bit formats halve (vs. float)
+// or quarter (vs. double) the bytes streamed per weight while arithmetic stays in fp32.
+enum class Precision {
+    Double,
+    BFloat16,
+    Float16
+};
+
+// Function to convert a float to bfloat16 with round-to-nearest-even
+inline uint16_t floatToBFloat16(float value) {
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    if ((bits & 0x7FFFFFFFu) > 0x7F800000u) {
+        return static_cast<uint16_t>((bits >> 16) | 0x0040u); // keep NaNs quiet
+    }
+    bits += 0x7FFFu + ((bits >> 16) & 1u);
+    return static_cast<uint16_t>(bits >> 16);
+}
+
+// Function to convert a bfloat16 back to float (exact)
+inline float bfloat16ToFloat(uint16_t value) {
+    uint32_t bits = static_cast<uint32_t>(value) << 16;
+    float result;
+    std::memcpy(&result, &bits, sizeof(result));
+    return result;
+}
+
+// Function to convert a float to IEEE half precision with round-to-nearest-even.
+// Uses the F16C instruction when the compiler targets it, a bit-exact software path otherwise.
+inline uint16_t floatToHalf(float value) {
+#if defined(__F16C__)
+    return static_cast<uint16_t>(_cvtss_sh(value, 0));
+#else
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    uint32_t sign = (bits >> 16) & 0x8000u;
+    uint32_t magnitude = bits & 0x7FFFFFFFu;
+    if (magnitude >= 0x7F800000u) {
+        return static_cast<uint16_t>(sign | (magnitude > 0x7F800000u ? 0x7E00u : 0x7C00u));
+    }
+    if (magnitude >= 0x477FF000u) {
+        return static_cast<uint16_t>(sign | 0x7C00u); // rounds to at least 65520: overflow
+    }
+    if (magnitude < 0x38800000u) {
+        // Subnormal result: count units of 2^-24 and round to nearest even
+        float absolute;
+        std::memcpy(&absolute, &magnitude, sizeof(absolute));
+        return static_cast<uint16_t>(sign | static_cast<uint32_t>(std::nearbyint(absolute * 16777216.0f)));
+    }
+    magnitude += 0xFFFu + ((magnitude >> 13) & 1u);
+    return static_cast<uint16_t>(sign | ((magnitude - 0x38000000u) >> 13));
+#endif
+}
+
+// Function to convert an IEEE half back to float (exact)
+inline float halfToFloat(uint16_t value) {
+#if defined(__F16C__)
+    return _cvtsh_ss(value);
+#else
+    // Branch-free so that loops decoding whole rows still vectorize: normal numbers are
+    // rebiased by a multiplication, subnormals are produced by a magic-number subtraction.
+    uint32_t word = static_cast<uint32_t>(value) << 16;
+    uint32_t sign = word & 0x80000000u;
+    uint32_t twice = word + word;
+    uint32_t normalBits = (twice >> 4) + (0xE0u << 23);
+    uint32_t subnormalBits = (twice >> 17) | (126u << 23);
+    float normal;
+    float subnormal;
+    std::memcpy(&normal, &normalBits, sizeof(normal));
+    std::memcpy(&subnormal, &subnormalBits, sizeof(subnormal));
+    normal *= 0x1.0p-112f;
+    subnormal -= 0.5f;
+    std::memcpy(&normalBits, &normal, sizeof(normalBits));
+    std::memcpy(&subnormalBits, &subnormal, sizeof(subnormalBits));
+    uint32_t subnormalMask = 0u - static_cast<uint32_t>(twice < (1u << 27));
+    uint32_t resultBits = sign | (subnormalBits & subnormalMask) | (normalBits & ~subnormalMask);
+    float result;
+    std::memcpy(&result, &resultBits, sizeof(result));
+    return result;
+#endif
+}
+
+// Storage policies used as template parameters by the layer kernels
+struct BFloat16Storage {
+    static uint16_t encode(float value) { return floatToBFloat16(value); }
+    static float decode(uint16_t value) { return bfloat16ToFloat(value); }
+};
+
+struct Float16Storage {
+    static uint16_t encode(float value) { return floatToHalf(value); }
+    static float decode(uint16_t value) { return halfToFloat(value); }
+};
+
+// Function to check whether the fp16 kernels can convert in hardware on this machine (AVX and
+// F16C). Without it every weight costs a software conversion and fp16 is slower than double.
+inline bool hasHardwareFloat16() {
+#if defined(__F16C__)
+    return true;
+#elif defined(NN_F16C_KERNELS)
+    static const bool supported = __builtin_cpu_supports("avx") && __builtin_cpu_supports("f16c");
+    return supported;
+#else
+    return false;
+#endif
+}
+
+#endif // HALFPRECISION_H
@@ -0,0 +1,283 @@
+#include "HyperparameterSearch.h"
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <fstream>
+#include <numeric>
+#include <stdexcept>
+#include <thread>
+#include <omp.h>
+
+namespace {
+
+const char* optimizerName(OptimizerType type) {
+    switch (type) {
+    case OptimizerType::SGD: return "SGD";
+    case OptimizerType::Momentum: return "Momentum";
+    case OptimizerType::Nesterov: return "Nesterov";
+    case OptimizerType::Adam: return "Adam";
+    }
+    return "Unknown";
+}
+
+// Function to reject a candidate whose network or batches could not be built
+void validateCandidate(const SearchCandidate& candidate) {
+    if (candidate.batchSize < 1) {
+        throw std::invalid_argument("HyperparameterSearch candidates need a positive batch size");
+    }
+    for (int size : candidate.hiddenSizes) {
+        if (size < 1) {
+            throw std::invalid_argument("HyperparameterSearch candidates need positive hidden layer sizes");
+        }
+    }
+}
+
+} // namespace
+
+// Constructor taking the input and output widths shared by every candidate network
+HyperparameterSearch::HyperparameterSearch(int inputSize, int outputSize)
+    : m_inputSize(inputSize), m_outputSize(outputSize), m_minEpochs(1), m_maxEpochs(27), m_reductionFactor(3),
+    m_validationSplit(0.1), m_lossFunction(LossFunction::SoftmaxCrossEntropy), m_numThreads(omp_get_max_threads()) {}
+
+// Function to add one candidate; throws std::invalid_argument for a batch size
+// or hidden layer size below one
+void HyperparameterSearch::addCandidate(const SearchCandidate& candidate) {
+    validateCandidate(candidate);
+    m_candidates.push_back(candidate);
+}
+
+// Function to add every combination of the given settings as a candidate.
+// Throws std::invalid_argument, without adding any, if one of them is invalid.
+void HyperparameterSearch::addGrid(const std::vector<std::vector<int>>& hiddenSizes, const std::vector<double>& learningRates,
+                                   const std::vector<int>& batchSizes, const std::vector<OptimizerType>& optimizers) {
+    std::vector<SearchCandidate> grid;
+    for (const std::vector<int>& hidden : hiddenSizes) {
+        for (double learningRate : learningRates) {
+            for (int batchSize : batchSizes) {
+                for (OptimizerType optimizer : optimizers) {
+                    SearchCandidate candidate;
+                    candidate.hiddenSizes = hidden;
+                    candidate.learningRate = learningRate;
+                    candidate.batchSize = batchSize;
+                    candidate.optimizer = optimizer;
+                    validateCandidate(candidate);
+                    grid.push_back(candidate);
+                }
+            }
+        }
+    }
+    m_candidates.insert(m_candidates.end(), grid.begin(), grid.end());
+}
+
+int HyperparameterSearch::candidateCount() const {
+    return static_cast<int>(m_candidates.size());
+}
+
+// Function to set the epochs of the first rung, the most epochs any candidate gets,
+// and the factor by which the field shrinks and the budget grows from rung to rung
+void HyperparameterSearch::setSchedule(int minEpochs, int maxEpochs, int reductionFactor) {
+    m_minEpochs = std::max(1, minEpochs);
+    m_maxEpochs = std::max(m_minEpochs, maxEpochs);
+    m_reductionFactor = std::max(2, reductionFactor);
+}
+
+// Function to set the fraction of the data held out for scoring the candidates
+void HyperparameterSearch::setValidationSplit(double fraction) {
+    m_validationSplit = std::min(std::max(fraction, 0.01), 0.9);
+}
+
+void HyperparameterSearch::setLossFunction(LossFunction loss) {
+    m_lossFunction = loss;
+}
+
+void HyperparameterSearch::setNumThreads(int threads) {
+    m_numThreads = std::max(1, threads);
+}
+
+// Function to set the file the ranking is written to after every rung (empty disables it)
+void HyperparameterSearch::setSummaryFile(const std::string& path) {
+    m_summaryFile = path;
+}
+
+const std::vector<SearchResult>& HyperparameterSearch::results() const {
+    return m_results;
+}
+
+/**
+ * @brief Runs the successive-halving search.
+ *
+ * @param inputs A vector of input vectors; a random validation split of them is used for scoring only.
+ * @param labels The target label of every input vector.
+ * @return The best candidate's network, trained for the epochs of the last rung it reached.
+ * @throws std::invalid_argument If no candidates were added, the labels do not match the inputs or
+ *         the output size, or there are fewer than two samples to split into training and validation.
+ * @throws Whatever a candidate's training threw, once all of the rung's workers have finished.
+ */
+std::unique_ptr<NeuralNetwork> HyperparameterSearch::run(const std::vector<std::vector<double>>& inputs,
+                                                         const std::vector<int>& labels) {
+    if (m_candidates.empty()) {
+        throw std::invalid_argument("HyperparameterSearch has no candidates");
+    }
+    if (inputs.size() != labels.size() || inputs.size() < 2) {
+        throw std::invalid_argument("HyperparameterSearch needs one label per input and at least two samples");
+    }
+    for (int label : labels) {
+        if (label < 0 || label >= m_outputSize) {
+            throw std::invalid_argument("HyperparameterSearch label out of range");
+        }
+    }
+    std::random_device rd;
+    std::mt19937 g(rd());
+
+    // Hold out one validation split that scores every candidate
+    int numSamples = static_cast<int>(inputs.size());
+    std::vector<int> order(numSamples);
+    std::iota(order.begin(), order.end(), 0);
+    std::shuffle(order.begin(), order.end(), g);
+    int numValidation = std::min(numSamples - 1, std::max(1, static_cast<int>(numSamples * m_validationSplit)));
+    std::vector<int> validationIndices(order.end() - numValidation, order.end());
+    std::vector<int> trainIndices(order.begin(), order.end() - numValidation);
+
+    // Build one network per candidate
+    const int numCandidates = candidateCount();
+    std::vector<Trial> trials(numCandidates);
+    m_results.assign(numCandidates, SearchResult());
+    for (int c = 0; c < numCandidates; ++c) {
+        const SearchCandidate& candidate = m_candidates[c];
+        std::vector<int> layerSizes;
+        layerSizes.push_back(m_inputSize);
+        layerSizes.insert(layerSizes.end(), candidate.hiddenSizes.begin(), candidate.hiddenSizes.end());
+        layerSizes.push_back(m_outputSize);
+
+        OptimizerConfig config;
+        config.type = candidate.optimizer;
+        config.learningRate = candidate.learningRate;
+        trials[c].network.reset(new NeuralNetwork(layerSizes, candidate.learningRate));
+        trials[c].network->setOptimizer(config);
+        trials[c].network->setLossFunction(m_lossFunction);
+        trials[c].rng.seed(g());
+        trials[c].order = trainIndices;
+        m_results[c].candidate = candidate;
+    }
+
+    std::vector<int> alive(numCandidates);
+    std::iota(alive.begin(), alive.end(), 0);
+    int trainedEpochs = 0;
+    int budget = m_minEpochs;
+
+    for (int rung = 0;; ++rung) {
+        // Split the threads evenly between the candidates still alive
+        const int survivors = static_cast<int>(alive.size());
+        const int threadsEach = std::max(1, m_numThreads / survivors);
+        const int workers = std::min(survivors, m_numThreads);
+        const int epochs = budget - trainedEpochs;
+        std::atomic<int> next(0);
+
+        // An exception must not escape a worker thread; it is rethrown after the join
+        std::vector<std::exception_ptr> failures(survivors);
+        auto work = [&]() {
+            for (int k = next++; k < survivors; k = next++) {
+                try {
+                    int c = alive[k];
+                    NeuralNetwork& network = *trials[c].network;
+                    network.setNumThreads(threadsEach);
+                    trainEpochs(trials[c], m_candidates[c].batchSize, epochs, inputs, labels);
+                    m_results[c].accuracy = network.evaluate(inputs, labels, validationIndices);
+                    m_results[c].epochsTrained = budget;
+                    m_results[c].rungReached = rung;
+                } catch (...) {
+                    failures[k] = std::current_exception();
+                }
+            }
+        };
+        std::vector<std::thread> pool;
+        for (int w = 1; w < workers; ++w) {
+            pool.emplace_back(work);
+        }
+        work();
+        for (std::thread& thread : pool) {
+            thread.join();
+        }
+        for (const std::exception_ptr& failure : failures) {
+            if (failure) {
+                std::rethrow_exception(failure);
+            }
+        }
+        trainedEpochs = budget;
+
+        // Rank the survivors and record the state of the search
+        std::stable_sort(alive.begin(), alive.end(), [this](int a, int b) {
+            return m_results[a].accuracy > m_results[b].accuracy;
+        });
+        for (int c : alive) {
+            emit candidateEvaluated(c, rung, m_results[c].accuracy);
+        }
+        writeSummary();
+        emit trainingProgress(QString("Rung %1: %2 candidates after %3 epochs, best validation accuracy %4%")
+                                  .arg(rung).arg(survivors).arg(budget).arg(m_results[alive.front()].accuracy * 100.0));
+
+        if (survivors == 1 || budget >= m_maxEpochs) {
+            break;
+        }
+
+        // Keep the best 1/reductionFactor and free the others' networks
+        int keep = std::max(1, survivors / m_reductionFactor);
+        for (int k = keep; k < survivors; ++k) {
+            trials[alive[k]].network.reset();
+        }
+        alive.resize(keep);
+        budget = std::min(budget * m_reductionFactor, m_maxEpochs);
+    }
+
+    std::unique_ptr<NeuralNetwork> best = std::move(trials[alive.front()].network);
+    best->setNumThreads(m_numThreads);
+    best->publishSnapshot();
+    return best;
+}
+
+// Function to train one candidate for a number of epochs on its own shuffles of the training indices
+void HyperparameterSearch::trainEpochs(Trial& trial, int batchSize, int epochs, const std::vector<std::vector<double>>& inputs,
+                                       const std::vector<int>& labels) {
+    const int numInputs = static_cast<int>(trial.order.size());
+    std::vector<const double*> batchInputs(batchSize);
+    std::vector<int> batchLabels(batchSize);
+    for (int epoch = 0; epoch < epochs; ++epoch) {
+        std::shuffle(trial.order.begin(), trial.order.end(), trial.rng);
+        for (int start = 0; start < numInputs; start += batchSize) {
+            int end = std::min(start + batchSize, numInputs);
+            for (int i = start; i < end; ++i) {
+                batchInputs[i - start] = inputs[trial.order[i]].data();
+                batchLabels[i - start] = labels[trial.order[i]];
+            }
+            trial.network->trainBatch(batchInputs.data(), batchLabels.data(), end - start);
+        }
+    }
+}
+
+// Function to write all candidates, best first, with the rung and accuracy they reached
+void HyperparameterSearch::writeSummary() const {
+    if (m_summaryFile.empty()) {
+        return;
+    }
+    std::vector<int> ranking(m_results.size());
+    std::iota(ranking.begin(), ranking.end(), 0);
+    std::stable_sort(ranking.begin(), ranking.end(), [this](int a, int b) {
+        if (m_results[a].rungReached != m_results[b].rungReached) {
+            return m_results[a].rungReached > m_results[b].rungReached;
+        }
+        return m_results[a].accuracy > m_results[b].accuracy;
+    });
+
+    std::ofstream file(m_summaryFile);
+    file << "rank,candidate,hidden_sizes,learning_rate,batch_size,optimizer,rung,epochs,validation_accuracy\n";
+    for (size_t r = 0; r < ranking.size(); ++r) {
+        const SearchResult& result = m_results[ranking[r]];
+        file << r + 1 << "," << ranking[r] << ",";
+        for (size_t h = 0; h < result.candidate.hiddenSizes.size(); ++h) {
+            file << (h > 0 ? "-" : "") << result.candidate.hiddenSizes[h];
+        }
+        file << "," << result.candidate.learningRate << "," << result.candidate.batchSize << ","
+             << optimizerName(result.candidate.optimizer) << "," << result.rungReached << ","
+             << result.epochsTrained << "," << result.accuracy << "\n";
+    }
+}
@@ -0,0 +1,88 @@
+#ifndef HYPERPARAMETERSEARCH_H
+#define HYPERPARAMETERSEARCH_H
+
+#include "Neuronal_Network.h"
+#include <QObject>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+// One point of the search space
+struct SearchCandidate {
+    std::vector<int> hiddenSizes;
+    double learningRate = 0.001;
+    int batchSize = 32;
+    OptimizerType optimizer = OptimizerType::Adam;
+};
+
+// Outcome of one candidate: how far it got and its latest validation accuracy
+struct SearchResult {
+    SearchCandidate candidate;
+    int epochsTrained = 0;
+    int rungReached = 0;
+    double accuracy = 0.0;
+};
+
+/**
+ * @brief Successive-halving search over network settings.
+ *
+ * All candidates are trained for minEpochs and scored on a held-out split.
+ * Only the best 1/reductionFactor of them continue, with reductionFactor times
+ * the epoch budget; this repeats until one candidate is left or the budget
+ * reaches maxEpochs. Survivors keep their weights and optimizer state between
+ * rungs, so no work is repeated.
+ *
+ * Candidates of a rung train concurrently on their own std::threads, and the
+ * thread budget is split evenly between them: as weak candidates are dropped,
+ * the survivors get the freed cores for their OpenMP teams.
+ */
+class HyperparameterSearch : public QObject {
+    Q_OBJECT
+
+public:
+    HyperparameterSearch(int inputSize, int outputSize);
+
+    void addCandidate(const SearchCandidate& candidate);
+    void addGrid(const std::vector<std::vector<int>>& hiddenSizes, const std::vector<double>& learningRates,
+                 const std::vector<int>& batchSizes, const std::vector<OptimizerType>& optimizers);
+    int candidateCount() const;
+
+    void setSchedule(int minEpochs, int maxEpochs, int reductionFactor = 3);
+    void setValidationSplit(double fraction);
+    void setLossFunction(LossFunction loss);
+    void setNumThreads(int threads);
+    void setSummaryFile(const std::string& path);
+
+    std::unique_ptr<NeuralNetwork> run(const std::vector<std::vector<double>>& inputs, const std::vector<int>& labels);
+    const std::vector<SearchResult>& results() const;
+
+signals:
+    void trainingProgress(QString message);
+    void candidateEvaluated(int candidate, int rung, double accuracy);
+
+private:
+    struct Trial {
+        std::unique_ptr<NeuralNetwork> network;
+        std::mt19937 rng;
+        std::vector<int> order;
+    };
+
+    int m_inputSize;
+    int m_outputSize;
+    std::vector<SearchCandidate> m_candidates;
+    std::vector<SearchResult> m_results;
+    int m_minEpochs;
+    int m_maxEpochs;
+    int m_reductionFactor;
+    double m_validationSplit;
+    LossFunction m_lossFunction;
+    int m_numThreads;
+    std::string m_summaryFile;
+
+    void trainEpochs(Trial& trial, int batchSize, int epochs, const std::vector<std::vector<double>>& inputs,
+                     const std::vector<int>& labels);
+    void writeSummary() const;
+};
+
+#endif // HYPERPARAMETERSEARCH_H
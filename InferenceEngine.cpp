@@ -0,0 +1,184 @@
+#include "InferenceEngine.h"
+#include "Neuronal_Network.h"
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+
+// Number of samples classified together; their activations stay in cache across layers
+const int blockSize = 64;
+
+// Number of samples sharing one pass over a weight panel
+const int samplesPerPass = 4;
+
+/**
+ * @brief Computes one layer for a block of samples from panel-packed weights.
+ *
+ * For every panel the accumulators of Samples samples (Samples x panelWidth
+ * floats) start at the bias, receive one broadcast multiply-add per input and
+ * are written once, already passed through the activation policy.
+ */
+template <typename Policy>
+struct PackedKernel {
+    template <int Samples, typename T>
+    static void pass(const float* weights, const float* biases, int cols, int rows, int panels,
+                     const T* const* inputs, float* outputs, int outputStride) {
+        const int width = InferenceEngine::panelWidth;
+        for (int p = 0; p < panels; ++p) {
+            const float* panel = weights + static_cast<size_t>(p) * cols * width;
+            float acc[Samples][width];
+            for (int s = 0; s < Samples; ++s) {
+                for (int j = 0; j < width; ++j) {
+                    acc[s][j] = biases[p * width + j];
+                }
+            }
+            for (int i = 0; i < cols; ++i) {
+                const float* w = panel + i * width;
+                for (int s = 0; s < Samples; ++s) {
+                    const float x = static_cast<float>(inputs[s][i]);
+#pragma omp simd
+                    for (int j = 0; j < width; ++j) {
+                        acc[s][j] += w[j] * x;
+                    }
+                }
+            }
+            const int valid = std::min(width, rows - p * width);
+            for (int s = 0; s < Samples; ++s) {
+                float* out = outputs + s * outputStride + p * width;
+                for (int j = 0; j < valid; ++j) {
+                    out[j] = static_cast<float>(Policy::forward(acc[s][j]));
+                }
+            }
+        }
+    }
+
+    template <typename T>
+    static void run(const float* weights, const float* biases, int cols, int rows, int panels,
+                    const T* const* inputs, int count, float* outputs, int outputStride) {
+        int s = 0;
+        for (; s + samplesPerPass <= count; s += samplesPerPass) {
+            pass<samplesPerPass>(weights, biases, cols, rows, panels, inputs + s,
+                                 outputs + s * outputStride, outputStride);
+        }
+        for (; s < count; ++s) {
+            pass<1>(weights, biases, cols, rows, panels, inputs + s, outputs + s * outputStride, outputStride);
+        }
+    }
+};
+
+}
+
+// Constructor to freeze and repack the evaluation weights of a trained network (its weight average, if used)
+InferenceEngine::InferenceEngine(const NeuralNetwork& network) : m_widest(0) {
+    for (const DenseLayer& layer : network.getEvaluationLayers()) {
+        PackedLayer packed;
+        packed.inputSize = layer.inputSize();
+        packed.outputSize = layer.outputSize();
+        packed.panels = (packed.outputSize + panelWidth - 1) / panelWidth;
+        packed.activation = layer.activation();
+        packed.weights.assign(static_cast<size_t>(packed.panels) * packed.inputSize * panelWidth, 0.0f);
+        packed.biases.assign(static_cast<size_t>(packed.panels) * panelWidth, 0.0f);
+
+        const MyMatrix& weights = layer.weights();
+        for (int o = 0; o < packed.outputSize; ++o) {
+            int panel = o / panelWidth;
+            int lane = o % panelWidth;
+            float* destination = packed.weights.data() + static_cast<size_t>(panel) * packed.inputSize * panelWidth;
+            for (int i = 0; i < packed.inputSize; ++i) {
+                destination[i * panelWidth + lane] = static_cast<float>(weights(o, i));
+            }
+            packed.biases[o] = static_cast<float>(layer.biases()(o, 0));
+        }
+        m_widest = std::max(m_widest, packed.panels * panelWidth);
+        m_layers.push_back(std::move(packed));
+    }
+    if (m_layers.empty()) {
+        throw std::invalid_argument("Cannot build an inference engine from an empty network");
+    }
+}
+
+int InferenceEngine::inputSize() const {
+    return m_layers.front().inputSize;
+}
+
+int InferenceEngine::outputSize() const {
+    return m_layers.back().outputSize;
+}
+
+// Function to classify a single input vector
+int InferenceEngine::classify(const std::vector<double>& input) const {
+    const double* row = input.data();
+    int result = 0;
+    classifyBatch(&row, 1, &result);
+    return result;
+}
+
+// Function to classify a whole dataset
+std::vector<int> InferenceEngine::classifyBatch(const std::vector<std::vector<double>>& inputs) const {
+    std::vector<const double*> rows(inputs.size());
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        rows[i] = inputs[i].data();
+    }
+    std::vector<int> classes(inputs.size());
+    classifyBatch(rows.data(), static_cast<int>(rows.size()), classes.data());
+    return classes;
+}
+
+/**
+ * @brief Classifies count samples, writing the index of the largest output of each.
+ *
+ * Large batches are split into blocks that are distributed over OpenMP threads;
+ * every thread works in its own scratch buffers, so the engine itself is never
+ * written to.
+ *
+ * @param inputs One pointer per sample to its input vector (inputSize values).
+ * @param count The number of samples.
+ * @param classes Output array receiving one class index per sample.
+ */
+void InferenceEngine::classifyBatch(const double* const* inputs, int count, int* classes) const {
+    if (count <= blockSize) {
+        std::vector<float> current(static_cast<size_t>(blockSize) * m_widest);
+        std::vector<float> next(static_cast<size_t>(blockSize) * m_widest);
+        classifyBlock(inputs, count, classes, current, next);
+        return;
+    }
+#pragma omp parallel
+    {
+        std::vector<float> current(static_cast<size_t>(blockSize) * m_widest);
+        std::vector<float> next(static_cast<size_t>(blockSize) * m_widest);
+#pragma omp for schedule(static)
+        for (int start = 0; start < count; start += blockSize) {
+            int n = std::min(blockSize, count - start);
+            classifyBlock(inputs + start, n, classes + start, current, next);
+        }
+    }
+}
+
+// Function to run one block of at most blockSize samples through every layer
+void InferenceEngine::classifyBlock(const double* const* inputs, int count, int* classes,
+                                    std::vector<float>& current, std::vector<float>& next) const {
+    const float* rows[blockSize];
+    const int stride = m_widest;
+
+    for (size_t l = 0; l < m_layers.size(); ++l) {
+        const PackedLayer& layer = m_layers[l];
+        if (l == 0) {
+            dispatchActivation<PackedKernel>(layer.activation, layer.weights.data(), layer.biases.data(),
+                                             layer.inputSize, layer.outputSize, layer.panels,
+                                             inputs, count, next.data(), stride);
+        } else {
+            dispatchActivation<PackedKernel>(layer.activation, layer.weights.data(), layer.biases.data(),
+                                             layer.inputSize, layer.outputSize, layer.panels,
+                                             rows, count, next.data(), stride);
+        }
+        current.swap(next);
+        for (int s = 0; s < count; ++s) {
+            rows[s] = current.data() + s * stride;
+        }
+    }
+
+    const int outputs = m_layers.back().outputSize;
+    for (int s = 0; s < count; ++s) {
+        classes[s] = static_cast<int>(std::max_element(rows[s], rows[s] + outputs) - rows[s]);
+    }
+}
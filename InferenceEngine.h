@@ -0,0 +1,49 @@
+#ifndef INFERENCEENGINE_H
+#define INFERENCEENGINE_H
+
+#include "Activation.h"
+#include <vector>
+
+class NeuralNetwork;
+
+// A frozen, read-only copy of a trained NeuralNetwork for serving.
+//
+// The weights of every layer are converted to float, transposed and packed
+// into panels of panelWidth output neurons: panel p stores, for each input i,
+// the weights of outputs p*panelWidth .. p*panelWidth+panelWidth-1 next to each
+// other. The kernel broadcasts one input value and updates a whole panel of
+// accumulators with it, which maps directly onto one SIMD register per sample.
+// Bias and activation are applied while the accumulators are still in registers.
+//
+// All classify calls are const and may be used from several threads at once.
+class InferenceEngine {
+public:
+    static const int panelWidth = 8;
+
+    explicit InferenceEngine(const NeuralNetwork& network);
+
+    int inputSize() const;
+    int outputSize() const;
+
+    int classify(const std::vector<double>& input) const;
+    void classifyBatch(const double* const* inputs, int count, int* classes) const;
+    std::vector<int> classifyBatch(const std::vector<std::vector<double>>& inputs) const;
+
+private:
+    struct PackedLayer {
+        int inputSize;
+        int outputSize;
+        int panels;
+        Activation activation;
+        std::vector<float> weights; // panels x inputSize x panelWidth
+        std::vector<float> biases;  // panels x panelWidth, zero padded
+    };
+
+    std::vector<PackedLayer> m_layers;
+    int m_widest;
+
+    void classifyBlock(const double* const* inputs, int count, int* classes,
+                       std::vector<float>& current, std::vector<float>& next) const;
+};
+
+#endif // INFERENCEENGINE_H
@@ -0,0 +1,604 @@
+#include "Layer.h"
+#include <cmath>
+#include <stdexcept>
+
+// Default constructor for an empty layer
+DenseLayer::DenseLayer() : m_activation(Activation::Sigmoid), m_precision(Precision::Double) {}
+
+// Constructor to create a layer mapping inputSize values to outputSize values
+DenseLayer::DenseLayer(int inputSize, int outputSize, Activation activation)
+    : m_weights(outputSize, inputSize), m_biases(outputSize, 1), m_activation(activation),
+    m_precision(Precision::Double) {}
+
+// Constructor to create a layer from existing weight and bias matrices
+DenseLayer::DenseLayer(const MyMatrix& weights, const MyMatrix& biases, Activation activation)
+    : m_weights(weights), m_biases(biases), m_activation(activation), m_precision(Precision::Double)
+{
+    if (m_biases.rows() != m_weights.rows() || m_biases.columns() != 1) {
+        throw std::invalid_argument("Bias vector does not match the layer's weight matrix");
+    }
+}
+
+// Function to get the number of inputs of the layer
+int DenseLayer::inputSize() const {
+    return m_weights.columns();
+}
+
+// Function to get the number of outputs of the layer
+int DenseLayer::outputSize() const {
+    return m_weights.rows();
+}
+
+// Functions to access the weight matrix
+MyMatrix& DenseLayer::weights() {
+    return m_weights;
+}
+
+const MyMatrix& DenseLayer::weights() const {
+    return m_weights;
+}
+
+// Functions to access the bias vector
+MyMatrix& DenseLayer::biases() {
+    return m_biases;
+}
+
+const MyMatrix& DenseLayer::biases() const {
+    return m_biases;
+}
+
+// Functions to access the activation function of the layer
+Activation DenseLayer::activation() const {
+    return m_activation;
+}
+
+void DenseLayer::setActivation(Activation activation) {
+    m_activation = activation;
+}
+
+// Functions to access the storage precision used by the forward and backward kernels
+Precision DenseLayer::storagePrecision() const {
+    return m_precision;
+}
+
+// Throws std::invalid_argument for fp16 on a machine without hardware fp16 conversion (see hasHardwareFloat16())
+void DenseLayer::setStoragePrecision(Precision precision) {
+    if (precision == Precision::Float16 && !hasHardwareFloat16()) {
+        throw std::invalid_argument("fp16 storage needs a CPU with F16C");
+    }
+    m_precision = precision;
+    if (m_precision == Precision::Double) {
+        m_lowPrecisionWeights.clear();
+        m_lowPrecisionWeights.shrink_to_fit();
+    } else {
+        m_lowPrecisionWeights.resize(static_cast<size_t>(outputSize()) * inputSize());
+        refreshLowPrecisionWeights();
+    }
+}
+
+// Function to re-encode the 16-bit weight copy from the double master weights.
+// Like the optimizer step it is an orphaned OpenMP loop, so a calling team shares the work.
+void DenseLayer::refreshLowPrecisionWeights() {
+    if (m_precision == Precision::Double) {
+        return;
+    }
+    const int count = outputSize() * inputSize();
+    const double* w = m_weights.data();
+    uint16_t* packed = m_lowPrecisionWeights.data();
+    if (m_precision == Precision::BFloat16) {
+#pragma omp for schedule(static)
+        for (int i = 0; i < count; ++i) {
+            packed[i] = floatToBFloat16(static_cast<float>(w[i]));
+        }
+    } else {
+#pragma omp for schedule(static)
+        for (int i = 0; i < count; ++i) {
+            packed[i] = floatToHalf(static_cast<float>(w[i]));
+        }
+    }
+}
+
+// Function to get the half-width of the uniform range used to initialize this layer.
+// Sigmoid and linear layers keep the historical [-1, 1]; ReLU-style layers use the
+// He range and tanh layers the Glorot range so their activations do not saturate.
+double DenseLayer::initializationRange() const {
+    switch (m_activation) {
+    case Activation::ReLU:
+    case Activation::LeakyReLU:
+        return std::sqrt(6.0 / inputSize());
+    case Activation::Tanh:
+        return std::sqrt(6.0 / (inputSize() + outputSize()));
+    default:
+        return 1.0;
+    }
+}
+
+// Function to initialize weights and biases randomly between minVal and maxVal
+void DenseLayer::randomize(double minVal, double maxVal) {
+    m_weights.randomize(minVal, maxVal);
+    m_biases.randomize(minVal, maxVal);
+    refreshLowPrecisionWeights();
+}
+
+// Function to initialize weights and biases from the given generator
+void DenseLayer::randomize(double minVal, double maxVal, std::mt19937& generator) {
+    m_weights.randomize(minVal, maxVal, generator);
+    m_biases.randomize(minVal, maxVal, generator);
+    refreshLowPrecisionWeights();
+}
+
+namespace {
+
+// Largest share of non-zero inputs for which gradient() walks a sample's non-zeros instead
+// of its whole row; above it the contiguous dense loop is faster than the indexed one
+const double sparseInputDensity = 0.5;
+
+// The forward kernels accumulate four weight rows (and in batches two samples) in one sweep
+// over the columns. Every loaded weight and input then feeds several independent sums, which
+// stay in registers instead of forming one long chain of dependent additions. Each sum still
+// adds its products in column order, so it equals the plain dot product bit for bit.
+const int forwardTileRows = 4;
+
+// Function to compute the dot product of one weight row with one input
+inline double dot(const double* row, const double* input, int cols) {
+    double sum = 0.0;
+    for (int i = 0; i < cols; ++i) {
+        sum += row[i] * input[i];
+    }
+    return sum;
+}
+
+// Function to compute the dot products of four consecutive weight rows with one input
+inline void dotTile4x1(const double* w, int cols, const double* input, double* sums) {
+    const double* r0 = w;
+    const double* r1 = w + cols;
+    const double* r2 = w + 2 * cols;
+    const double* r3 = w + 3 * cols;
+    double s0 = 0.0, s1 = 0.0, s2 = 0.0, s3 = 0.0;
+    for (int i = 0; i < cols; ++i) {
+        const double x = input[i];
+        s0 += r0[i] * x;
+        s1 += r1[i] * x;
+        s2 += r2[i] * x;
+        s3 += r3[i] * x;
+    }
+    sums[0] = s0;
+    sums[1] = s1;
+    sums[2] = s2;
+    sums[3] = s3;
+}
+
+// Function to compute the dot products of four consecutive weight rows with two inputs;
+// sums receives the four sums of the first input, then those of the second
+inline void dotTile4x2(const double* w, int cols, const double* input0, const double* input1, double* sums) {
+    const double* r0 = w;
+    const double* r1 = w + cols;
+    const double* r2 = w + 2 * cols;
+    const double* r3 = w + 3 * cols;
+    double s00 = 0.0, s10 = 0.0, s20 = 0.0, s30 = 0.0;
+    double s01 = 0.0, s11 = 0.0, s21 = 0.0, s31 = 0.0;
+    for (int i = 0; i < cols; ++i) {
+        const double x0 = input0[i];
+        const double x1 = input1[i];
+        s00 += r0[i] * x0;
+        s01 += r0[i] * x1;
+        s10 += r1[i] * x0;
+        s11 += r1[i] * x1;
+        s20 += r2[i] * x0;
+        s21 += r2[i] * x1;
+        s30 += r3[i] * x0;
+        s31 += r3[i] * x1;
+    }
+    sums[0] = s00;
+    sums[1] = s10;
+    sums[2] = s20;
+    sums[3] = s30;
+    sums[4] = s01;
+    sums[5] = s11;
+    sums[6] = s21;
+    sums[7] = s31;
+}
+
+// Kernel computing activation(weights * input + biases) for one sample, four rows per sweep
+// over the input. Bias and activation are applied while the sums are still in registers.
+template <typename Policy>
+struct ForwardKernel {
+    static void run(const double* w, const double* b, int rows, int cols, const double* input, double* output) {
+        int o = 0;
+        for (; o + forwardTileRows <= rows; o += forwardTileRows) {
+            double sums[forwardTileRows];
+            dotTile4x1(w + o * cols, cols, input, sums);
+            for (int r = 0; r < forwardTileRows; ++r) {
+                output[o + r] = Policy::forward(sums[r] + b[o + r]);
+            }
+        }
+        for (; o < rows; ++o) {
+            output[o] = Policy::forward(dot(w + o * cols, input, cols) + b[o]);
+        }
+    }
+};
+
+// Kernel computing the activations of a block of samples in tiles of four weight rows by two
+// samples. The weight rows of a tile stay in cache for the whole block, and each output is
+// written once, with bias and activation applied to the finished sum.
+template <typename Policy>
+struct ForwardBatchKernel {
+    static void run(const double* w, const double* b, int rows, int cols,
+                    const double* const* inputs, int count, double* outputs) {
+        int o = 0;
+        for (; o + forwardTileRows <= rows; o += forwardTileRows) {
+            const double* tile = w + o * cols;
+            double sums[2 * forwardTileRows];
+            int s = 0;
+            for (; s + 2 <= count; s += 2) {
+                dotTile4x2(tile, cols, inputs[s], inputs[s + 1], sums);
+                for (int r = 0; r < forwardTileRows; ++r) {
+                    outputs[s * rows + o + r] = Policy::forward(sums[r] + b[o + r]);
+                    outputs[(s + 1) * rows + o + r] = Policy::forward(sums[forwardTileRows + r] + b[o + r]);
+                }
+            }
+            if (s < count) {
+                dotTile4x1(tile, cols, inputs[s], sums);
+                for (int r = 0; r < forwardTileRows; ++r) {
+                    outputs[s * rows + o + r] = Policy::forward(sums[r] + b[o + r]);
+                }
+            }
+        }
+        for (; o < rows; ++o) {
+            for (int s = 0; s < count; ++s) {
+                outputs[s * rows + o] = Policy::forward(dot(w + o * cols, inputs[s], cols) + b[o]);
+            }
+        }
+    }
+};
+
+// Kernel applying the activation to pre-activations in place
+template <typename Policy>
+struct ActivateKernel {
+    static void run(double* values, int count) {
+        for (int i = 0; i < count; ++i) {
+            values[i] = Policy::forward(values[i]);
+        }
+    }
+};
+
+// Kernel multiplying back-propagated errors by the activation derivative
+template <typename Policy>
+struct DerivativeKernel {
+    static void run(const double* outputs, double* errors, int count) {
+        for (int i = 0; i < count; ++i) {
+            errors[i] = Policy::derivative(outputs[i]) * errors[i];
+        }
+    }
+};
+
+// Kernels reading 16-bit weights: products are accumulated in fp32 and every
+// output is rounded to the storage format, as if it had been stored in 16 bits.
+template <typename Storage>
+struct LowPrecision {
+    template <typename Policy>
+    struct ForwardKernel {
+        static void run(const uint16_t* w, const double* b, int rows, int cols, const double* input, double* output) {
+            for (int o = 0; o < rows; ++o) {
+                const uint16_t* row = w + o * cols;
+                float sum = 0.0f;
+#pragma omp simd reduction(+:sum)
+                for (int i = 0; i < cols; ++i) {
+                    sum += Storage::decode(row[i]) * static_cast<float>(input[i]);
+                }
+                float activation = static_cast<float>(Policy::forward(sum + b[o]));
+                output[o] = Storage::decode(Storage::encode(activation));
+            }
+        }
+    };
+
+    template <typename Policy>
+    struct ForwardBatchKernel {
+        static void run(const uint16_t* w, const double* b, int rows, int cols,
+                        const double* const* inputs, int count, double* outputs) {
+            for (int o = 0; o < rows; ++o) {
+                const uint16_t* row = w + o * cols;
+                for (int s = 0; s < count; ++s) {
+                    const double* input = inputs[s];
+                    float sum = 0.0f;
+#pragma omp simd reduction(+:sum)
+                    for (int i = 0; i < cols; ++i) {
+                        sum += Storage::decode(row[i]) * static_cast<float>(input[i]);
+                    }
+                    float activation = static_cast<float>(Policy::forward(sum + b[o]));
+                    outputs[s * rows + o] = Storage::decode(Storage::encode(activation));
+                }
+            }
+        }
+    };
+
+    static void backward(const uint16_t* w, int rows, int cols, const double* delta, double* inputError) {
+        for (int i = 0; i < cols; ++i) {
+            inputError[i] = 0.0;
+        }
+        for (int o = 0; o < rows; ++o) {
+            const uint16_t* row = w + o * cols;
+            const float d = static_cast<float>(delta[o]);
+#pragma omp simd
+            for (int i = 0; i < cols; ++i) {
+                inputError[i] += Storage::decode(row[i]) * d;
+            }
+        }
+    }
+};
+
+#if defined(NN_F16C_KERNELS)
+// fp16 kernels converting eight weights per instruction with F16C. They are compiled for
+// AVX/F16C even when the rest of the file is not; setStoragePrecision() only allows fp16
+// where hasHardwareFloat16() confirms the CPU runs them. Like the generic kernels they
+// accumulate in fp32 and round every output to fp16.
+struct Float16Kernels {
+    // Function to compute the fp32 dot product of an fp16 weight row with a double input row
+    __attribute__((target("avx,f16c")))
+    static float dot(const uint16_t* row, const double* input, int cols) {
+        __m256 sum = _mm256_setzero_ps();
+        int i = 0;
+        for (; i + 8 <= cols; i += 8) {
+            __m256 weights = _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i)));
+            __m256 values = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm256_cvtpd_ps(_mm256_loadu_pd(input + i))),
+                                                 _mm256_cvtpd_ps(_mm256_loadu_pd(input + i + 4)), 1);
+            sum = _mm256_add_ps(sum, _mm256_mul_ps(weights, values));
+        }
+        __m128 half = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+        half = _mm_add_ps(half, _mm_movehl_ps(half, half));
+        half = _mm_add_ss(half, _mm_shuffle_ps(half, half, 1));
+        float total = _mm_cvtss_f32(half);
+        for (; i < cols; ++i) {
+            total += _cvtsh_ss(row[i]) * static_cast<float>(input[i]);
+        }
+        return total;
+    }
+
+    // Function to round an activation to fp16 and back
+    __attribute__((target("avx,f16c")))
+    static double round(double activation) {
+        return _cvtsh_ss(static_cast<uint16_t>(_cvtss_sh(static_cast<float>(activation), 0)));
+    }
+
+    template <typename Policy>
+    struct ForwardKernel {
+        __attribute__((target("avx,f16c")))
+        static void run(const uint16_t* w, const double* b, int rows, int cols, const double* input, double* output) {
+            for (int o = 0; o < rows; ++o) {
+                output[o] = round(Policy::forward(dot(w + o * cols, input, cols) + b[o]));
+            }
+        }
+    };
+
+    template <typename Policy>
+    struct ForwardBatchKernel {
+        __attribute__((target("avx,f16c")))
+        static void run(const uint16_t* w, const double* b, int rows, int cols,
+                        const double* const* inputs, int count, double* outputs) {
+            for (int o = 0; o < rows; ++o) {
+                const uint16_t* row = w + o * cols;
+                for (int s = 0; s < count; ++s) {
+                    outputs[s * rows + o] = round(Policy::forward(dot(row, inputs[s], cols) + b[o]));
+                }
+            }
+        }
+    };
+
+    __attribute__((target("avx,f16c")))
+    static void backward(const uint16_t* w, int rows, int cols, const double* delta, double* inputError) {
+        for (int i = 0; i < cols; ++i) {
+            inputError[i] = 0.0;
+        }
+        for (int o = 0; o < rows; ++o) {
+            const uint16_t* row = w + o * cols;
+            const float d = static_cast<float>(delta[o]);
+            const __m256 scale = _mm256_set1_ps(d);
+            int i = 0;
+            for (; i + 8 <= cols; i += 8) {
+                __m256 products = _mm256_mul_ps(
+                    _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i))), scale);
+                _mm256_storeu_pd(inputError + i, _mm256_add_pd(_mm256_loadu_pd(inputError + i),
+                                                               _mm256_cvtps_pd(_mm256_castps256_ps128(products))));
+                _mm256_storeu_pd(inputError + i + 4, _mm256_add_pd(_mm256_loadu_pd(inputError + i + 4),
+                                                                   _mm256_cvtps_pd(_mm256_extractf128_ps(products, 1))));
+            }
+            for (; i < cols; ++i) {
+                inputError[i] += _cvtsh_ss(row[i]) * d;
+            }
+        }
+    }
+};
+#else
+using Float16Kernels = LowPrecision<Float16Storage>;
+#endif
+
+}
+
+// Function to compute the activation of the layer for a single input vector
+void DenseLayer::forward(const double* input, double* output) const {
+    const int rows = outputSize();
+    const int cols = inputSize();
+    switch (m_precision) {
+    case Precision::Double:
+        dispatchActivation<ForwardKernel>(m_activation, m_weights.data(), m_biases.data(), rows, cols, input, output);
+        break;
+    case Precision::BFloat16:
+        dispatchActivation<LowPrecision<BFloat16Storage>::ForwardKernel>(
+            m_activation, m_lowPrecisionWeights.data(), m_biases.data(), rows, cols, input, output);
+        break;
+    case Precision::Float16:
+        dispatchActivation<Float16Kernels::ForwardKernel>(
+            m_activation, m_lowPrecisionWeights.data(), m_biases.data(), rows, cols, input, output);
+        break;
+    }
+}
+
+// Function to compute only the outputs begin..end-1 of the layer for a single input vector.
+// They are written to the same positions of output as forward() would write them.
+void DenseLayer::forwardRows(const double* input, double* output, int begin, int end) const {
+    const int rows = end - begin;
+    const int cols = inputSize();
+    if (rows <= 0) {
+        return;
+    }
+    const size_t offset = static_cast<size_t>(begin) * cols;
+    switch (m_precision) {
+    case Precision::Double:
+        dispatchActivation<ForwardKernel>(m_activation, m_weights.data() + offset, m_biases.data() + begin, rows, cols,
+                                          input, output + begin);
+        break;
+    case Precision::BFloat16:
+        dispatchActivation<LowPrecision<BFloat16Storage>::ForwardKernel>(
+            m_activation, m_lowPrecisionWeights.data() + offset, m_biases.data() + begin, rows, cols, input, output + begin);
+        break;
+    case Precision::Float16:
+        dispatchActivation<Float16Kernels::ForwardKernel>(
+            m_activation, m_lowPrecisionWeights.data() + offset, m_biases.data() + begin, rows, cols, input, output + begin);
+        break;
+    }
+}
+
+// Function to apply the layer's activation to outputSize pre-activation values in place
+void DenseLayer::activate(double* values) const {
+    dispatchActivation<ActivateKernel>(m_activation, values, outputSize());
+}
+
+// Function to compute the activations of a block of samples; outputs is count x outputSize.
+// Each weight row is applied to the whole block before moving on, so it is read from memory once.
+void DenseLayer::forwardBatch(const double* const* inputs, int count, double* outputs) const {
+    const int rows = outputSize();
+    const int cols = inputSize();
+    switch (m_precision) {
+    case Precision::Double:
+        dispatchActivation<ForwardBatchKernel>(m_activation, m_weights.data(), m_biases.data(),
+                                               rows, cols, inputs, count, outputs);
+        break;
+    case Precision::BFloat16:
+        dispatchActivation<LowPrecision<BFloat16Storage>::ForwardBatchKernel>(
+            m_activation, m_lowPrecisionWeights.data(), m_biases.data(), rows, cols, inputs, count, outputs);
+        break;
+    case Precision::Float16:
+        dispatchActivation<Float16Kernels::ForwardBatchKernel>(
+            m_activation, m_lowPrecisionWeights.data(), m_biases.data(), rows, cols, inputs, count, outputs);
+        break;
+    }
+}
+
+// Function to turn the error at the layer's outputs into the error at its pre-activation,
+// using the outputs computed by forward() (count values each)
+void DenseLayer::applyDerivative(const double* outputs, double* errors, int count) const {
+    dispatchActivation<DerivativeKernel>(m_activation, outputs, errors, count);
+}
+
+/**
+ * @brief Propagates the error of this layer back to its inputs.
+ *
+ * Computes inputError = weights^T * delta. The rows of the weight matrix are
+ * walked in order so the access stays contiguous; each inputError element is
+ * still accumulated in the same order as a column dot product would.
+ *
+ * @param delta The error at the layer's pre-activation (outputSize values).
+ * @param inputError Output buffer receiving the error at the layer's inputs (inputSize values).
+ */
+void DenseLayer::backward(const double* delta, double* inputError) const {
+    const int rows = outputSize();
+    const int cols = inputSize();
+    if (m_precision == Precision::BFloat16) {
+        LowPrecision<BFloat16Storage>::backward(m_lowPrecisionWeights.data(), rows, cols, delta, inputError);
+        return;
+    }
+    if (m_precision == Precision::Float16) {
+        Float16Kernels::backward(m_lowPrecisionWeights.data(), rows, cols, delta, inputError);
+        return;
+    }
+    const double* w = m_weights.data();
+    for (int i = 0; i < cols; ++i) {
+        inputError[i] = 0.0;
+    }
+    for (int o = 0; o < rows; ++o) {
+        const double* row = w + o * cols;
+        const double d = delta[o];
+        for (int i = 0; i < cols; ++i) {
+            inputError[i] += row[i] * d;
+        }
+    }
+}
+
+/**
+ * @brief Computes the mean weight and bias gradients over a batch.
+ *
+ * weightGradient = (1/batchCount) * sum_b deltas_b * inputs_b^T and
+ * biasGradient = (1/batchCount) * sum_b deltas_b. The rows of the gradient are
+ * distributed with an orphaned OpenMP worksharing loop, so every row is owned by
+ * one thread and no reduction between threads is needed.
+ *
+ * @param inputs One pointer per sample to the layer's input row (inputSize values).
+ * @param deltas The layer's error rows, batchCount x outputSize, row-major.
+ * @param batchCount The number of samples in the batch.
+ * @param weightGradient Output matrix of the same shape as the weights.
+ * @param biasGradient Output vector of the same shape as the biases.
+ * @param rowSquaredNorms Optional output, outputSize values: the squared norm of every
+ *                        gradient row including its bias, taken while the row is in cache.
+ * @param sparseInputs Optional non-zero entries of the inputs. Samples with at most
+ *                     sparseInputDensity non-zero inputs then only touch those columns
+ *                     of the gradient rows; the result is the same as the dense sum.
+ */
+void DenseLayer::gradient(const double* const* inputs, const double* deltas, int batchCount,
+                          MyMatrix& weightGradient, MyMatrix& biasGradient, double* rowSquaredNorms,
+                          const SparseRows* sparseInputs) const {
+#pragma omp for schedule(static)
+    for (int o = 0; o < outputSize(); ++o) {
+        gradientRows(inputs, deltas, batchCount, weightGradient, biasGradient, rowSquaredNorms, o, o + 1,
+                     sparseInputs);
+    }
+}
+
+// Function to compute the gradient rows begin..end-1 of gradient() on the calling thread only,
+// e.g. for the rows of a slice of the layer owned by one thread
+void DenseLayer::gradientRows(const double* const* inputs, const double* deltas, int batchCount, MyMatrix& weightGradient,
+                              MyMatrix& biasGradient, double* rowSquaredNorms, int begin, int end,
+                              const SparseRows* sparseInputs) const {
+    const int rows = outputSize();
+    const int cols = inputSize();
+    const double scale = 1.0 / batchCount;
+    double* gw = weightGradient.data();
+    double* gb = biasGradient.data();
+    for (int o = begin; o < end; ++o) {
+        double* row = gw + o * cols;
+        for (int i = 0; i < cols; ++i) {
+            row[i] = 0.0;
+        }
+        double biasSum = 0.0;
+        for (int b = 0; b < batchCount; ++b) {
+            const double d = deltas[b * rows + o];
+            if (d == 0.0) {
+                continue;
+            }
+            biasSum += d;
+            // A zero input adds nothing to its column, so a sparse sample only visits its non-zeros
+            if (sparseInputs && sparseInputs->counts[b] <= cols * sparseInputDensity) {
+                const int* index = sparseInputs->indices + static_cast<size_t>(b) * sparseInputs->stride;
+                const double* value = sparseInputs->values + static_cast<size_t>(b) * sparseInputs->stride;
+                const int nonZeros = sparseInputs->counts[b];
+                for (int k = 0; k < nonZeros; ++k) {
+                    row[index[k]] += d * value[k];
+                }
+                continue;
+            }
+            const double* input = inputs[b];
+            for (int i = 0; i < cols; ++i) {
+                row[i] += d * input[i];
+            }
+        }
+        double squaredNorm = 0.0;
+#pragma omp simd reduction(+:squaredNorm)
+        for (int i = 0; i < cols; ++i) {
+            row[i] *= scale;
+            squaredNorm += row[i] * row[i];
+        }
+        gb[o] = biasSum * scale;
+        if (rowSquaredNorms) {
+            rowSquaredNorms[o] = squaredNorm + gb[o] * gb[o];
+        }
+    }
+}
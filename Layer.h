@@ -0,0 +1,72 @@
+#ifndef LAYER_H
+#define LAYER_H
+
+#include "Matrix.h"
+#include "Activation.h"
+#include "HalfPrecision.h"
+#include <cstdint>
+#include <vector>
+
+// The non-zero entries of a batch of input rows, e.g. mostly blank images: row b
+// has counts[b] entries, their columns at indices + b * stride and their values
+// at values + b * stride.
+struct SparseRows {
+    const int* indices;
+    const double* values;
+    const int* counts;
+    int stride;
+};
+
+// A fully connected layer: output = activation(weights * input + biases).
+// Weights are stored as (outputSize x inputSize), biases as (outputSize x 1).
+// All kernels work on raw row pointers so callers can point them into
+// preallocated batch buffers without creating temporaries.
+//
+// With a 16-bit storage precision the forward and backward kernels read a
+// bfloat16/fp16 copy of the weights, accumulate in fp32 and round the layer's
+// outputs to the storage format. The double weights remain the master copy that
+// gradients and optimizers work on; refreshLowPrecisionWeights() re-derives the
+// 16-bit copy after they change.
+class DenseLayer {
+private:
+    MyMatrix m_weights;
+    MyMatrix m_biases;
+    Activation m_activation;
+    Precision m_precision;
+    std::vector<uint16_t> m_lowPrecisionWeights;
+
+public:
+    DenseLayer();
+    DenseLayer(int inputSize, int outputSize, Activation activation = Activation::Sigmoid);
+    DenseLayer(const MyMatrix& weights, const MyMatrix& biases, Activation activation = Activation::Sigmoid);
+
+    int inputSize() const;
+    int outputSize() const;
+    MyMatrix& weights();
+    const MyMatrix& weights() const;
+    MyMatrix& biases();
+    const MyMatrix& biases() const;
+    Activation activation() const;
+    void setActivation(Activation activation);
+    Precision storagePrecision() const;
+    void setStoragePrecision(Precision precision);
+    void refreshLowPrecisionWeights();
+
+    double initializationRange() const;
+    void randomize(double minVal, double maxVal);
+    void randomize(double minVal, double maxVal, std::mt19937& generator);
+    void forward(const double* input, double* output) const;
+    void forwardRows(const double* input, double* output, int begin, int end) const;
+    void activate(double* values) const;
+    void forwardBatch(const double* const* inputs, int count, double* outputs) const;
+    void applyDerivative(const double* outputs, double* errors, int count) const;
+    void backward(const double* delta, double* inputError) const;
+    void gradient(const double* const* inputs, const double* deltas, int batchCount,
+                  MyMatrix& weightGradient, MyMatrix& biasGradient, double* rowSquaredNorms = nullptr,
+                  const SparseRows* sparseInputs = nullptr) const;
+    void gradientRows(const double* const* inputs, const double* deltas, int batchCount, MyMatrix& weightGradient,
+                      MyMatrix& biasGradient, double* rowSquaredNorms, int begin, int end,
+                      const SparseRows* sparseInputs = nullptr) const;
+};
+
+#endif // LAYER_H
@@ -1,6 +1,5 @@
 #include "Matrix.h"
 #include <cstdlib>
-#include <ctime>
 #include <stdexcept>
 
 // Default constructor for an empty matrix
@@ -14,6 +13,14 @@ MyMatrix::MyMatrix(int rows, int cols)
 MyMatrix::MyMatrix(const MyMatrix& other)
     : m_rows(other.m_rows), m_cols(other.m_cols), m_data(other.m_data){}
 
+// Copy assignment operator to replace the contents with those of another matrix
+MyMatrix& MyMatrix::operator=(const MyMatrix& other) {
+    m_rows = other.m_rows;
+    m_cols = other.m_cols;
+    m_data = other.m_data;
+    return *this;
+}
+
 // Constructor to initialize a matrix from a given vector
 MyMatrix::MyMatrix(const std::vector<double>& values, bool isColumn)
 {
@@ -59,6 +66,16 @@ double& MyMatrix::operator()(int row, int col){
     return m_data[row * m_cols + col];
 }
 
+// Function to access the underlying row-major storage (read-write)
+double* MyMatrix::data(){
+    return m_data.data();
+}
+
+// Function to access the underlying row-major storage (read-only)
+const double* MyMatrix::data() const{
+    return m_data.data();
+}
+
 // Function to calculate the sum of all elements in the matrix
 double MyMatrix::sum() const{
     double total = 0.0;
@@ -158,10 +175,17 @@ void MyMatrix::operator*=(const MyMatrix& other){
 
 // Function to randomize the matrix with values between minVal and maxVal
 void MyMatrix::randomize(double minVal, double maxVal){
-    std::srand(std::time(nullptr));
-    double range = maxVal - minVal;
+    std::random_device rd;
+    std::mt19937 generator(rd());
+    randomize(minVal, maxVal, generator);
+}
+
+// Function to randomize the matrix with values between minVal and maxVal drawn from the given generator,
+// so a fixed seed reproduces the same matrix
+void MyMatrix::randomize(double minVal, double maxVal, std::mt19937& generator){
+    std::uniform_real_distribution<double> distribution(minVal, maxVal);
     for (int i = 0; i < m_rows * m_cols; ++i) {
-        m_data[i] = (std::rand() / static_cast<double>(RAND_MAX)) * range + minVal;
+        m_data[i] = distribution(generator);
     }
 }
 
@@ -3,6 +3,7 @@
 
 #include <vector>
 #include <functional>
+#include <random>
 
 class MyMatrix {
 private:
@@ -15,12 +16,15 @@ public:
     MyMatrix(int rows, int cols);
     MyMatrix(const MyMatrix& other);
     MyMatrix(const std::vector<double>& values, bool isColumn = true);
+    MyMatrix& operator=(const MyMatrix& other);
 
     int rows() const;
     int columns() const;
     double sum() const;
     double operator()(int row, int col) const;
     double& operator()(int row, int col);
+    double* data();
+    const double* data() const;
 
     MyMatrix operator+(const MyMatrix& other) const;
     MyMatrix operator-(const MyMatrix& other) const;
@@ -33,6 +37,7 @@ public:
     void resize(int newRows, int newCols);
 
     void randomize(double minVal, double maxVal);
+    void randomize(double minVal, double maxVal, std::mt19937& generator);
     MyMatrix transpose() const;
     std::vector<std::vector<double>> toList() const;
     void fromList(const std::vector<std::vector<double>>& list);
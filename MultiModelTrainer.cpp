@@ -0,0 +1,124 @@
+#include "MultiModelTrainer.h"
+#include "BatchLoader.h"
+#include <algorithm>
+#include <exception>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+#include <omp.h>
+
+// Constructor taking the models to train together; they must all read inputs of the same size
+MultiModelTrainer::MultiModelTrainer(const std::vector<NeuralNetwork*>& models)
+    : m_models(models), m_validationSplit(0.0), m_numThreads(omp_get_max_threads()) {
+    if (m_models.empty()) {
+        throw std::invalid_argument("MultiModelTrainer needs at least one model");
+    }
+    for (const NeuralNetwork* model : m_models) {
+        if (model->getLayer(0).inputSize() != m_models.front()->getLayer(0).inputSize()) {
+            throw std::invalid_argument("All models of a MultiModelTrainer need the same input size");
+        }
+    }
+}
+
+int MultiModelTrainer::modelCount() const {
+    return static_cast<int>(m_models.size());
+}
+
+// Function to hold out a fraction of the training data for validation (0 disables it)
+void MultiModelTrainer::setValidationSplit(double fraction) {
+    m_validationSplit = std::min(std::max(fraction, 0.0), 0.9);
+}
+
+void MultiModelTrainer::setNumThreads(int threads) {
+    m_numThreads = std::max(1, threads);
+}
+
+/**
+ * @brief Trains all models for a number of epochs on the same shuffled mini-batches.
+ *
+ * @param inputs A vector of input vectors, each representing the features of a training example.
+ * @param labels The target label of every input vector.
+ * @param epochs The number of passes over the training data.
+ * @param batchSize The number of training examples in each mini-batch.
+ * @return The final validation accuracy of every model, or its mean training loss of
+ *         the last epoch if no validation split is set.
+ */
+std::vector<double> MultiModelTrainer::train(const std::vector<std::vector<double>>& inputs,
+                                             const std::vector<int>& labels, int epochs, int batchSize) {
+    std::random_device rd;
+    std::mt19937 g(rd());
+    const int numModels = modelCount();
+
+    // Hold out a random validation subset shared by all models
+    int numSamples = static_cast<int>(inputs.size());
+    std::vector<int> order(numSamples);
+    std::iota(order.begin(), order.end(), 0);
+    int numValidation = static_cast<int>(numSamples * m_validationSplit);
+    if (numValidation > 0) {
+        std::shuffle(order.begin(), order.end(), g);
+    }
+    std::vector<int> validationIndices(order.end() - numValidation, order.end());
+    std::vector<int> indices(order.begin(), order.end() - numValidation);
+    int numInputs = static_cast<int>(indices.size());
+
+    // Train the models side by side with one thread each, or one after another with all threads.
+    // The guard gives every model its own thread count back, also when training throws.
+    const bool concurrentModels = numModels > 1 && numModels >= m_numThreads;
+    struct ThreadCountGuard {
+        const std::vector<NeuralNetwork*>& models;
+        std::vector<int> saved;
+        ~ThreadCountGuard() {
+            for (size_t m = 0; m < models.size(); ++m) {
+                models[m]->setNumThreads(saved[m]);
+            }
+        }
+    } threadGuard{ m_models, std::vector<int>(numModels) };
+    for (int m = 0; m < numModels; ++m) {
+        threadGuard.saved[m] = m_models[m]->getNumThreads();
+        m_models[m]->setNumThreads(concurrentModels ? 1 : m_numThreads);
+    }
+
+    BatchLoader loader(inputs, labels, batchSize);
+    std::vector<double> errors(numModels);
+    std::vector<double> results(numModels);
+
+    for (int epoch = 0; epoch < epochs; ++epoch) {
+        std::shuffle(indices.begin(), indices.end(), g);
+        std::fill(errors.begin(), errors.end(), 0.0);
+
+        // Every batch is gathered once, in the background, for all models
+        loader.startEpoch(indices);
+        BatchLoader::Batch batch;
+        while (loader.next(batch)) {
+            // An exception must not leave the parallel region; it is rethrown after it
+            std::vector<std::exception_ptr> failures(numModels);
+#pragma omp parallel for num_threads(m_numThreads) schedule(dynamic, 1) if (concurrentModels)
+            for (int m = 0; m < numModels; ++m) {
+                try {
+                    errors[m] += m_models[m]->trainBatch(batch.inputs, batch.labels, batch.count);
+                } catch (...) {
+                    failures[m] = std::current_exception();
+                }
+            }
+            for (const std::exception_ptr& failure : failures) {
+                if (failure) {
+                    std::rethrow_exception(failure);
+                }
+            }
+        }
+
+        // Score every model and report its progress
+        for (int m = 0; m < numModels; ++m) {
+            m_models[m]->setNumThreads(m_numThreads);
+            double error = errors[m] / std::max(numInputs, 1);
+            double accuracy = numValidation > 0 ? m_models[m]->evaluate(inputs, labels, validationIndices) : 0.0;
+            m_models[m]->setNumThreads(concurrentModels ? 1 : m_numThreads);
+            m_models[m]->publishSnapshot();
+            results[m] = numValidation > 0 ? accuracy : error;
+            emit modelEpochCompleted(m, epoch, error, accuracy);
+        }
+        emit trainingProgress(QString("Epoch %1 completed for %2 models.").arg(epoch).arg(numModels));
+    }
+
+    return results;
+}
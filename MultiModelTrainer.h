@@ -0,0 +1,41 @@
+#ifndef MULTIMODELTRAINER_H
+#define MULTIMODELTRAINER_H
+
+#include "Neuronal_Network.h"
+#include <QObject>
+#include <vector>
+
+// Trains several networks in one pass over the data, e.g. for a learning-rate
+// or hidden-size sweep. Every epoch is shuffled once and every mini-batch is
+// gathered once, then fed to all models while it is still hot in cache, so the
+// data cost is paid once for the whole sweep.
+//
+// With at least as many models as threads, the models train concurrently with
+// one thread each; otherwise they take turns, each using its full thread team.
+// The models keep their own optimizer, loss and precision settings; their
+// train()-level options (validation split, early stopping, budgets,
+// checkpoints) are not used.
+class MultiModelTrainer : public QObject {
+    Q_OBJECT
+
+public:
+    explicit MultiModelTrainer(const std::vector<NeuralNetwork*>& models);
+
+    int modelCount() const;
+    void setValidationSplit(double fraction);
+    void setNumThreads(int threads);
+
+    std::vector<double> train(const std::vector<std::vector<double>>& inputs, const std::vector<int>& labels,
+                              int epochs, int batchSize);
+
+signals:
+    void trainingProgress(QString message);
+    void modelEpochCompleted(int model, int epoch, double error, double accuracy);
+
+private:
+    std::vector<NeuralNetwork*> m_models;
+    double m_validationSplit;
+    int m_numThreads;
+};
+
+#endif // MULTIMODELTRAINER_H
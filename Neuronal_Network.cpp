@@ -6,25 +6,31 @@
 #include <string>
 #include <numeric>
 #include <random>
+#include <chrono>
+#include <thread>
+#include <stdexcept>
+#include <sstream>
+#include "BinaryIO.h"
+#include "BatchLoader.h"
 #include <QString>
 #include <omp.h>
 
 
 // Implementation of Getter Methods
 inline MyMatrix NeuralNetwork::getWeights1() const {
-    return weights1;
+    return layers[0].weights();
 }
 
 inline MyMatrix NeuralNetwork::getBiases1() const {
-    return biases1;
+    return layers[0].biases();
 }
 
 inline MyMatrix NeuralNetwork::getWeights2() const {
-    return weights2;
+    return layers[1].weights();
 }
 
 inline MyMatrix NeuralNetwork::getBiases2() const {
-    return biases2;
+    return layers[1].biases();
 }
 
 inline int NeuralNetwork::getInputSize() const {
@@ -40,38 +46,972 @@ inline int NeuralNetwork::getOutputSize() const {
 }
 
 inline double NeuralNetwork::getLearningRate() const {
-    return learningRate;
+    return optimizer.config().learningRate;
 }
+
+int NeuralNetwork::getLayerCount() const {
+    return static_cast<int>(layers.size());
+}
+
+const DenseLayer& NeuralNetwork::getLayer(int index) const {
+    return layers.at(index);
+}
+
+// Function to get the width of every layer, starting with the input layer
+std::vector<int> NeuralNetwork::getLayerSizes() const {
+    std::vector<int> sizes;
+    sizes.push_back(inputSize);
+    for (const DenseLayer& layer : layers) {
+        sizes.push_back(layer.outputSize());
+    }
+    return sizes;
+}
+
+int NeuralNetwork::getNumThreads() const {
+    return numThreads;
+}
+
+void NeuralNetwork::setNumThreads(int threads) {
+    numThreads = std::max(1, threads);
+}
+
+const OptimizerConfig& NeuralNetwork::getOptimizerConfig() const {
+    return optimizer.config();
+}
+
+LossFunction NeuralNetwork::getLossFunction() const {
+    return lossFunction;
+}
+
+// Function to change the activation function of one layer. The weights are kept,
+// so this is meant to be called right after construction.
+void NeuralNetwork::setLayerActivation(int index, Activation activation) {
+    layers.at(index).setActivation(activation);
+    publishSnapshot();
+}
+
+Precision NeuralNetwork::getPrecision() const {
+    return precision;
+}
+
+/**
+ * @brief Selects the storage format of the weight copies read by the forward and backward kernels.
+ *
+ * A 16-bit format keeps a bf16/fp16 copy of every weight, accumulates in fp32
+ * and rounds every layer's outputs to the format. Master weights, gradients,
+ * optimizer state and the activation buffers stay in double precision.
+ *
+ * The copy quarters the weight bytes streamed per sample, so bf16 only pays off
+ * for layers too wide to stay in cache (e.g. 4096 hidden units). On the
+ * 784-128-47 EMNIST shape, double is as fast or faster unless the build
+ * targets AVX2 (see benchmarks/precision_benchmark). fp16 converts eight
+ * weights per instruction and needs a CPU with F16C.
+ *
+ * @param newPrecision The storage format.
+ * @throws std::invalid_argument For a 16-bit format while model-parallel training is on,
+ *                               or for fp16 on a CPU without F16C.
+ */
+void NeuralNetwork::setPrecision(Precision newPrecision) {
+    if (modelParallel && newPrecision != Precision::Double) {
+        throw std::invalid_argument("Model-parallel training only supports double precision");
+    }
+    if (newPrecision == Precision::Float16 && !hasHardwareFloat16()) {
+        throw std::invalid_argument("fp16 storage needs a CPU with F16C");
+    }
+    precision = newPrecision;
+    for (DenseLayer& layer : layers) {
+        layer.setStoragePrecision(precision);
+    }
+}
+
+// Function to publish a snapshot every given number of batches during training,
+// in addition to the one published at the end of every epoch (0 = epochs only)
+void NeuralNetwork::setSnapshotInterval(int batches) {
+    snapshotInterval = std::max(0, batches);
+}
+
+/**
+ * @brief Freezes the current weights into an InferenceEngine and makes it the latest snapshot.
+ *
+ * Must be called from the thread that modifies the weights (the training thread
+ * while train() runs). Readers that still use an older snapshot keep it alive
+ * until they release it; publishing never waits for them.
+ */
+void NeuralNetwork::publishSnapshot() {
+    snapshotPointer.publish(std::unique_ptr<InferenceEngine>(new InferenceEngine(*this)));
+}
+
+// Function to get the latest published snapshot of the weights. It is safe to call
+// from any thread, also while another thread trains, and never blocks.
+RcuPointer<InferenceEngine>::ReadGuard NeuralNetwork::snapshot() const {
+    return snapshotPointer.read();
+}
+
+// Function to write a checkpoint of the complete training state to path every given number
+// of batches and at the end of every epoch (0 = epochs only). An empty path disables checkpointing.
+void NeuralNetwork::setCheckpointing(const std::string& path, int everyBatches) {
+    checkpointPath = path;
+    checkpointInterval = std::max(0, everyBatches);
+    if (!checkpointPath.empty() && !checkpointWriter) {
+        checkpointWriter.reset(new CheckpointWriter());
+    }
+}
+
+/**
+ * @brief Queues a binary checkpoint of the network and the training run for writing.
+ *
+ * The checkpoint holds the layers, loss function, precision, the optimizer's
+ * step counter and moment estimates, the weight average if one is kept, and the TrainingState (epoch, next batch,
+ * shuffle RNG, data split, current order and early-stopping bookkeeping).
+ * Serializing happens on the calling thread; the file itself is written by
+ * the CheckpointWriter's thread so training does not wait for the disk.
+ */
+void NeuralNetwork::saveCheckpoint() {
+    if (checkpointPath.empty() || !checkpointWriter) {
+        return;
+    }
+    std::ostringstream stream(std::ios::binary);
+    writeValue<unsigned>(stream, checkpointMagic);
+    writeValue<int>(stream, checkpointVersion);
+    writeLayers(stream, layers);
+    writeValue<int>(stream, static_cast<int>(lossFunction));
+    writeValue<int>(stream, static_cast<int>(precision));
+    optimizer.saveState(stream);
+    writeValue<double>(stream, averageDecay);
+    writeValue<int>(stream, evaluateAverage ? 1 : 0);
+    writeLayers(stream, averageLayers);
+    writeTrainingState(stream, trainingState);
+    checkpointWriter->submit(checkpointPath, stream.str());
+}
+
+/**
+ * @brief Waits until every queued checkpoint is on disk.
+ *
+ * Call it after train() has returned (e.g. after a stop request) and before
+ * the process exits, so the last checkpoint is not lost with the writer thread.
+ *
+ * @throws std::runtime_error If the last checkpoint write failed.
+ */
+void NeuralNetwork::flushCheckpoints() {
+    if (!checkpointWriter) {
+        return;
+    }
+    checkpointWriter->flush();
+    std::string error = checkpointWriter->lastError();
+    if (!error.empty()) {
+        throw std::runtime_error(error);
+    }
+}
+
+/**
+ * @brief Restores the network and its training run from a checkpoint written by saveCheckpoint().
+ *
+ * If the checkpointed run was still in progress, the next train() call with the
+ * same dataset and batch size continues with the batch after the checkpoint,
+ * using the same shuffle order and optimizer state as the interrupted run.
+ *
+ * @param path The checkpoint file.
+ * @throws std::runtime_error If the file cannot be read, is not a valid checkpoint or its parts do not fit together.
+ */
+void NeuralNetwork::resumeFromCheckpoint(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("Error opening checkpoint file");
+    }
+    if (readValue<unsigned>(file) != checkpointMagic || readValue<int>(file) != checkpointVersion) {
+        throw std::runtime_error("Not a compatible checkpoint file");
+    }
+    std::vector<DenseLayer> loaded = readLayers(file);
+    if (loaded.empty()) {
+        throw std::runtime_error("Checkpoint contains no layers");
+    }
+    int loss = readValue<int>(file);
+    int storedPrecision = readValue<int>(file);
+    if (loss < 0 || loss > static_cast<int>(LossFunction::SoftmaxCrossEntropy) ||
+        storedPrecision < 0 || storedPrecision > static_cast<int>(Precision::Float16)) {
+        throw std::runtime_error("Corrupt checkpoint data");
+    }
+    Optimizer restoredOptimizer;
+    restoredOptimizer.loadState(file);
+    double restoredDecay = readValue<double>(file);
+    bool restoredEvaluateAverage = readValue<int>(file) != 0;
+    std::vector<DenseLayer> restoredAverage = readLayers(file);
+    TrainingState state;
+    readTrainingState(file, state);
+
+    // Everything restored has to fit the restored layers, or the next train() would index out of bounds
+    if (!restoredOptimizer.matchesTensors(optimizerTensorSizes(loaded))) {
+        throw std::runtime_error("Checkpoint optimizer state does not match its layers");
+    }
+    if (!restoredAverage.empty() && !sameLayerShapes(restoredAverage, loaded)) {
+        throw std::runtime_error("Checkpoint weight average does not match its layers");
+    }
+    validateTrainingState(state, loaded);
+    if (modelParallel && (storedPrecision != static_cast<int>(Precision::Double) || loaded.size() != 2)) {
+        throw std::runtime_error("Checkpoint cannot be trained model-parallel");
+    }
+    if (storedPrecision == static_cast<int>(Precision::Float16) && !hasHardwareFloat16()) {
+        throw std::runtime_error("Checkpoint uses fp16 storage, which needs a CPU with F16C");
+    }
+
+    // Only touch the network once the whole file has been read successfully
+    layers = std::move(loaded);
+    updateLayerSizes();
+    lossFunction = static_cast<LossFunction>(loss);
+    optimizer = restoredOptimizer;
+    averageDecay = restoredDecay;
+    evaluateAverage = restoredEvaluateAverage;
+    averageLayers = std::move(restoredAverage);
+    trainingState = std::move(state);
+    setPrecision(static_cast<Precision>(storedPrecision));
+    publishSnapshot();
+}
+
+// Function to check whether an interrupted train() run can be continued
+bool NeuralNetwork::hasActiveTraining() const {
+    return trainingState.active;
+}
+
+// Function to discard an interrupted run so the next train() call starts from epoch 0
+void NeuralNetwork::resetTrainingState() {
+    trainingState = TrainingState();
+}
+
+// Function to ask a running train() call to stop after the current batch. It can be called
+// from any thread. The weights stay consistent and the run can be continued by calling train() again.
+// Without a running train() call it does nothing, so a late request cannot stop the next run.
+void NeuralNetwork::requestStop() {
+    int command = trainingCommand.load();
+    while ((command == RunCommand || command == PauseCommand) &&
+           !trainingCommand.compare_exchange_weak(command, StopCommand)) {
+    }
+}
+
+// Function to pause or continue a running train() call after the current batch; a pending stop is kept
+void NeuralNetwork::setPaused(bool paused) {
+    int expected = paused ? RunCommand : PauseCommand;
+    trainingCommand.compare_exchange_strong(expected, paused ? PauseCommand : RunCommand);
+}
+
+bool NeuralNetwork::isPaused() const {
+    return trainingCommand.load() == PauseCommand;
+}
+
+/**
+ * @brief Checks the training command at a batch boundary.
+ *
+ * Returns at once while training runs. While it is paused, the training thread
+ * sleeps in 1 ms steps until it is continued or stopped. A stop request is
+ * consumed, so the next train() call runs normally.
+ *
+ * @return True if train() has to stop now.
+ */
+bool NeuralNetwork::stopRequested() {
+    int command = trainingCommand.load();
+    if (command == PauseCommand) {
+        emit trainingProgress("Training paused.");
+        while ((command = trainingCommand.load()) == PauseCommand) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        if (command == RunCommand) {
+            emit trainingProgress("Training resumed.");
+        }
+    }
+    if (command == StopCommand) {
+        trainingCommand.compare_exchange_strong(command, RunCommand);
+        return true;
+    }
+    return false;
+}
+
+// Function to get the throughput and phase timings of the last finished epoch
+const EpochStats& NeuralNetwork::getLastEpochStats() const {
+    return lastEpochStats;
+}
+
+/**
+ * @brief Moves the oldest per-batch metrics records into out.
+ *
+ * Every trainBatch() call leaves one record in a lock-free ring buffer; this
+ * function may be called from any one thread while training runs (e.g. a GUI
+ * timer). If nobody polls, the newest records are dropped once the buffer is
+ * full, so training never waits for a reader.
+ *
+ * @param out The vector the records are appended to.
+ * @param maxCount The maximum number of records to take.
+ * @return The number of records appended.
+ */
+std::size_t NeuralNetwork::pollMetrics(std::vector<BatchMetrics>& out, std::size_t maxCount) {
+    return metrics.poll(out, maxCount);
+}
+
+// Function to get the number of metrics records lost because nobody polled them in time
+long long NeuralNetwork::droppedMetrics() const {
+    return metrics.dropped();
+}
+
+// Function to count the floating-point operations of one training sample: the
+// forward pass, the error propagated to every hidden layer and the weight gradients
+double NeuralNetwork::flopsPerSample() const {
+    double flops = 0.0;
+    for (size_t l = 0; l < layers.size(); ++l) {
+        double weightCount = static_cast<double>(layers[l].inputSize()) * layers[l].outputSize();
+        flops += (l > 0 ? 6.0 : 4.0) * weightCount;
+    }
+    return flops;
+}
+
+// Function to select the loss minimized by train(); this also sets the output layer's activation
+void NeuralNetwork::setLossFunction(LossFunction loss) {
+    lossFunction = loss;
+    applyOutputActivation();
+    publishSnapshot();
+}
+
+// Function to make the output layer linear for softmax heads and sigmoid otherwise
+void NeuralNetwork::applyOutputActivation() {
+    layers.back().setActivation(lossFunction == LossFunction::SoftmaxCrossEntropy ? Activation::Linear
+                                                                                 : Activation::Sigmoid);
+}
+
+// Function to hold out a fraction of the training data for validation (0 disables it)
+void NeuralNetwork::setValidationSplit(double fraction) {
+    validationSplit = std::min(std::max(fraction, 0.0), 0.9);
+}
+
+// Function to stop training once validation accuracy has not improved by more than
+// minDelta for patience consecutive epochs (0 disables early stopping)
+void NeuralNetwork::setEarlyStopping(int patience, double minDelta) {
+    earlyStoppingPatience = std::max(0, patience);
+    earlyStoppingMinDelta = minDelta;
+}
+
+/**
+ * @brief Enables loss-prioritized sampling of training samples (hard-example mining).
+ *
+ * train() keeps the loss every sample had the last time it was trained on. The
+ * first epoch visits all samples; each later epoch draws fraction * N samples
+ * (with replacement) with probability proportional to loss^exponent, mixed
+ * with a uniform share so no sample is starved. Samples the model already
+ * handles well are rarely revisited, so an epoch needs fewer sample visits.
+ *
+ * @param fraction Samples per epoch relative to the training set size (0 disables prioritized sampling).
+ * @param exponent How strongly the loss skews the draw (0 = uniform).
+ * @param uniformMix Share of the probability mass spread evenly over all samples.
+ */
+void NeuralNetwork::setPrioritizedSampling(double fraction, double exponent, double uniformMix) {
+    sampleFraction = std::max(0.0, fraction);
+    priorityExponent = std::max(0.0, exponent);
+    priorityUniformMix = std::min(std::max(uniformMix, 0.0), 1.0);
+}
+
+// Function to configure learnOnline(); lowering the replay capacity drops the surplus samples
+void NeuralNetwork::setOnlineLearning(const OnlineLearningConfig& config) {
+    onlineConfig = config;
+    onlineConfig.batchSize = std::max(1, config.batchSize);
+    onlineConfig.replayCapacity = std::max(0, config.replayCapacity);
+    if (static_cast<int>(replayInputs.size()) > onlineConfig.replayCapacity) {
+        replayInputs.resize(onlineConfig.replayCapacity);
+        replayLabels.resize(onlineConfig.replayCapacity);
+    }
+}
+
+const OnlineLearningConfig& NeuralNetwork::getOnlineLearning() const {
+    return onlineConfig;
+}
+
+/**
+ * @brief Adds samples to the replay buffer of learnOnline().
+ *
+ * The buffer is a reservoir sample: once it is full, the n-th sample offered
+ * replaces a random entry with probability capacity / n, so the buffer stays a
+ * uniform sample of everything offered so far. Use it to seed the buffer with
+ * (part of) the original training set.
+ *
+ * @param inputs The input vectors to offer.
+ * @param labels Their target labels.
+ */
+void NeuralNetwork::addToReplayBuffer(const std::vector<std::vector<double>>& inputs, const std::vector<int>& labels) {
+    const int capacity = onlineConfig.replayCapacity;
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        ++replaySeen;
+        if (static_cast<int>(replayInputs.size()) < capacity) {
+            replayInputs.push_back(inputs[i]);
+            replayLabels.push_back(labels[i]);
+            continue;
+        }
+        std::uniform_int_distribution<long long> pick(0, replaySeen - 1);
+        long long slot = pick(onlineRng);
+        if (slot < capacity) {
+            replayInputs[slot] = inputs[i];
+            replayLabels[slot] = labels[i];
+        }
+    }
+}
+
+int NeuralNetwork::replayBufferSize() const {
+    return static_cast<int>(replayInputs.size());
+}
+
+/**
+ * @brief Refreshes the model with a few newly labeled samples, e.g. operator corrections.
+ *
+ * The samples are trained on in small batches, each topped up with randomly
+ * replayed older samples so the model does not drift away from what it already
+ * knows. Updates are kept small: the optimizer's learning rate is scaled down
+ * and the gradient norm is clipped (see OnlineLearningConfig); the optimizer
+ * state carries over from earlier training. Afterwards the samples join the
+ * replay buffer and a new snapshot is published.
+ *
+ * Must not be called while train() runs on the same network.
+ *
+ * @param inputs The new input vectors.
+ * @param labels Their target labels.
+ * @return The mean loss of the new samples, measured before each update.
+ * @throws std::invalid_argument If inputs and labels differ in length or a label has no output unit.
+ */
+double NeuralNetwork::learnOnline(const std::vector<std::vector<double>>& inputs, const std::vector<int>& labels) {
+    if (inputs.size() != labels.size()) {
+        throw std::invalid_argument("learnOnline needs one label per input");
+    }
+    for (int label : labels) {
+        if (label < 0 || label >= outputSize) {
+            throw std::invalid_argument("learnOnline got a label without an output unit");
+        }
+    }
+    const int count = static_cast<int>(inputs.size());
+    if (count == 0) {
+        return 0.0;
+    }
+    const int newPerBatch = onlineConfig.batchSize;
+    const int replayPerBatch = replayInputs.empty() ? 0 : static_cast<int>(std::lround(newPerBatch * onlineConfig.replayRatio));
+    std::vector<const double*> batchInputs;
+    std::vector<int> batchLabels;
+    batchInputs.reserve(newPerBatch + replayPerBatch);
+    batchLabels.reserve(newPerBatch + replayPerBatch);
+
+    // Scale the step down and bound the gradient for the duration of the online updates;
+    // the guard puts both settings back on return and when a batch throws
+    struct SettingsGuard {
+        NeuralNetwork& network;
+        double learningRate;
+        double clipNorm;
+        ~SettingsGuard() {
+            network.optimizer.setLearningRate(learningRate);
+            network.gradientClipNorm = clipNorm;
+        }
+    } guard{ *this, optimizer.config().learningRate, gradientClipNorm };
+    optimizer.setLearningRate(guard.learningRate * onlineConfig.learningRateScale);
+    gradientClipNorm = onlineConfig.maxGradientNorm;
+
+    double loss = 0.0;
+    for (int start = 0; start < count; start += newPerBatch) {
+        int end = std::min(start + newPerBatch, count);
+        batchInputs.clear();
+        batchLabels.clear();
+        for (int i = start; i < end; ++i) {
+            batchInputs.push_back(inputs[i].data());
+            batchLabels.push_back(labels[i]);
+        }
+        if (replayPerBatch > 0) {
+            std::uniform_int_distribution<int> pick(0, static_cast<int>(replayInputs.size()) - 1);
+            for (int r = 0; r < replayPerBatch; ++r) {
+                int slot = pick(onlineRng);
+                batchInputs.push_back(replayInputs[slot].data());
+                batchLabels.push_back(replayLabels[slot]);
+            }
+        }
+        trainBatch(batchInputs.data(), batchLabels.data(), static_cast<int>(batchInputs.size()));
+
+        // The new samples occupy the first slots of the batch
+        for (int b = 0; b < end - start; ++b) {
+            loss += sampleLosses[b];
+        }
+    }
+
+    addToReplayBuffer(inputs, labels);
+    publishSnapshot();
+    return loss / count;
+}
+
+/**
+ * @brief Retrains only the output layer on cached activations of the layers below it.
+ *
+ * All other layers are frozen, so their output for every sample is computed
+ * once, in blocks through forwardBatch(), and kept in one contiguous float
+ * buffer of samples x hidden units. The output layer is then trained with the
+ * network's optimizer settings and loss on that buffer alone, which costs a
+ * small fraction of a full epoch. Passing a larger newOutputSize first adds
+ * freshly initialized output units, e.g. for classes beyond the original 47;
+ * the existing units keep their weights.
+ *
+ * Afterwards the optimizer state and any interrupted train() run are reset,
+ * because they no longer match the parameters.
+ *
+ * @param inputs A vector of input vectors, each representing the features of a training example.
+ * @param labels The target label of every input vector.
+ * @param epochs The number of passes over the cached activations.
+ * @param batchSize The number of training examples in each mini-batch.
+ * @param newOutputSize The number of output units to grow to (0 or no larger than now keeps the size).
+ * @return The mean training loss of the last epoch.
+ * @throws std::invalid_argument If the labels do not match the inputs or a label has no output unit.
+ */
+double NeuralNetwork::fineTuneHead(const std::vector<std::vector<double>>& inputs, const std::vector<int>& labels,
+                                   int epochs, int batchSize, int newOutputSize) {
+    if (inputs.size() != labels.size() || batchSize < 1) {
+        throw std::invalid_argument("fineTuneHead needs one label per input and a positive batch size");
+    }
+    const int targetOutputSize = std::max(outputSize, newOutputSize);
+    for (int label : labels) {
+        if (label < 0 || label >= targetOutputSize) {
+            throw std::invalid_argument("fineTuneHead got a label without an output unit");
+        }
+    }
+    if (newOutputSize > outputSize) {
+        growOutputLayer(newOutputSize);
+    }
+    const int numSamples = static_cast<int>(inputs.size());
+    const int numFrozen = static_cast<int>(layers.size()) - 1;
+    const int width = layers.back().inputSize();
+
+    // Run every sample through the frozen layers once
+    std::vector<float> features(static_cast<size_t>(numSamples) * width);
+    const int block = 64;
+    const int numBlocks = (numSamples + block - 1) / block;
+#pragma omp parallel num_threads(numThreads)
+    {
+        int widest = width;
+        for (int l = 0; l < numFrozen; ++l) {
+            widest = std::max(widest, layers[l].outputSize());
+        }
+        std::vector<double> buffers[2] = { std::vector<double>(block * widest), std::vector<double>(block * widest) };
+        std::vector<const double*> rows(block);
+
+#pragma omp for schedule(dynamic)
+        for (int blockIndex = 0; blockIndex < numBlocks; ++blockIndex) {
+            const int start = blockIndex * block;
+            const int count = std::min(block, numSamples - start);
+            for (int b = 0; b < count; ++b) {
+                rows[b] = inputs[start + b].data();
+            }
+            for (int l = 0; l < numFrozen; ++l) {
+                double* out = buffers[l % 2].data();
+                layers[l].forwardBatch(rows.data(), count, out);
+                for (int b = 0; b < count; ++b) {
+                    rows[b] = out + b * layers[l].outputSize();
+                }
+            }
+            for (int b = 0; b < count; ++b) {
+                float* feature = features.data() + static_cast<size_t>(start + b) * width;
+                for (int i = 0; i < width; ++i) {
+                    feature[i] = static_cast<float>(rows[b][i]);
+                }
+            }
+        }
+    }
+
+    // A one-layer network holding a copy of the output layer trains on the cache
+    NeuralNetwork head(std::vector<DenseLayer>{ layers.back() }, optimizer.config().learningRate);
+    head.lossFunction = lossFunction;
+    head.optimizer = Optimizer(optimizer.config());
+    head.resetOptimizer();
+    head.numThreads = numThreads;
+    head.precision = precision;
+    head.deterministic = deterministic;
+    head.seed = seed;
+
+    std::random_device rd;
+    std::mt19937 g(deterministic ? seed : rd());
+    std::vector<int> order(numSamples);
+    std::iota(order.begin(), order.end(), 0);
+    std::vector<double> batchData(static_cast<size_t>(batchSize) * width);
+    std::vector<const double*> batchInputs(batchSize);
+    std::vector<int> batchLabels(batchSize);
+    double error = 0.0;
+
+    for (int epoch = 0; epoch < epochs; ++epoch) {
+        std::shuffle(order.begin(), order.end(), g);
+        error = 0.0;
+        for (int start = 0; start < numSamples; start += batchSize) {
+            const int count = std::min(batchSize, numSamples - start);
+            for (int b = 0; b < count; ++b) {
+                const float* feature = features.data() + static_cast<size_t>(order[start + b]) * width;
+                double* row = batchData.data() + static_cast<size_t>(b) * width;
+                for (int i = 0; i < width; ++i) {
+                    row[i] = feature[i];
+                }
+                batchInputs[b] = row;
+                batchLabels[b] = labels[order[start + b]];
+            }
+            error += head.trainBatch(batchInputs.data(), batchLabels.data(), count);
+        }
+        error /= std::max(numSamples, 1);
+        emit trainingProgress(QString("Output layer epoch %1 completed. Error: %2").arg(epoch).arg(error));
+        emit errorReported(error);
+    }
+
+    // Take the trained output layer back
+    layers.back() = head.layers.front();
+    setPrecision(precision);
+    resetOptimizer();
+    resetTrainingState();
+    resetAverage();
+    publishSnapshot();
+    return error;
+}
+
+// Function to add output units; the new rows are initialized like a fresh layer and the old ones are kept
+void NeuralNetwork::growOutputLayer(int newOutputSize) {
+    const DenseLayer& old = layers.back();
+    const int oldSize = old.outputSize();
+    const int cols = old.inputSize();
+    MyMatrix weights(newOutputSize, cols);
+    MyMatrix biases(newOutputSize, 1);
+    DenseLayer fresh(cols, newOutputSize, old.activation());
+    std::random_device rd;
+    std::mt19937 generator(deterministic ? seed + newOutputSize : rd());
+    double range = fresh.initializationRange();
+    fresh.randomize(-range, range, generator);
+    for (int o = 0; o < newOutputSize; ++o) {
+        const DenseLayer& source = o < oldSize ? old : fresh;
+        for (int i = 0; i < cols; ++i) {
+            weights(o, i) = source.weights()(o, i);
+        }
+        biases(o, 0) = source.biases()(o, 0);
+    }
+    layers.back() = DenseLayer(weights, biases, old.activation());
+    updateLayerSizes();
+    resetOptimizer();
+    setPrecision(precision);
+    resetAverage();
+}
+
+// Function to draw the current epoch's order from the per-sample loss index
+void NeuralNetwork::samplePrioritizedOrder() {
+    TrainingState& state = trainingState;
+    const std::vector<int>& pool = state.trainIndices;
+    const int poolSize = static_cast<int>(pool.size());
+    std::vector<double> weights(poolSize);
+    double total = 0.0;
+    for (int i = 0; i < poolSize; ++i) {
+        weights[i] = std::pow(state.sampleLoss[pool[i]], priorityExponent);
+        total += weights[i];
+    }
+    for (int i = 0; i < poolSize; ++i) {
+        double priority = total > 0.0 ? weights[i] / total : 1.0 / poolSize;
+        weights[i] = (1.0 - priorityUniformMix) * priority + priorityUniformMix / poolSize;
+    }
+    std::discrete_distribution<int> distribution(weights.begin(), weights.end());
+    state.epochOrder.resize(std::max(1, static_cast<int>(poolSize * sampleFraction)));
+    for (int& index : state.epochOrder) {
+        index = pool[distribution(state.rng)];
+    }
+}
+
+// Function to cap a train() call by wall-clock seconds and/or processed samples (0 means no limit)
+void NeuralNetwork::setTrainingBudget(double maxSeconds, long long maxSamples) {
+    maxTrainingSeconds = maxSeconds;
+    maxTrainingSamples = maxSamples;
+}
+
+// Function to select the optimizer used by train(); its state starts from zero
+void NeuralNetwork::setOptimizer(const OptimizerConfig& config) {
+    optimizer = Optimizer(config);
+    resetOptimizer();
+}
+
+// Function to register every weight and bias tensor with the optimizer, clearing its state
+void NeuralNetwork::resetOptimizer() {
+    optimizer.reset(optimizerTensorSizes(layers));
+}
+
+// Function to list the optimizer's tensors for a layer stack: every layer's weights, then its biases
+std::vector<int> NeuralNetwork::optimizerTensorSizes(const std::vector<DenseLayer>& layerStack) {
+    std::vector<int> tensorSizes;
+    for (const DenseLayer& layer : layerStack) {
+        tensorSizes.push_back(layer.outputSize() * layer.inputSize());
+        tensorSizes.push_back(layer.outputSize());
+    }
+    return tensorSizes;
+}
+
 // Static class method that calculates the sigmoid of the value n
 double NeuralNetwork::calcSigmoid(double n) {
-    return 1.0 / (1.0 + std::exp(-n));
+    return SigmoidActivation::forward(n);
+}
+
+/**
+ * @brief Replaces logits by their softmax probabilities in place.
+ *
+ * The maximum is subtracted before exponentiating so large logits cannot
+ * overflow (log-sum-exp trick).
+ *
+ * @param values The logits, overwritten with probabilities.
+ * @param count The number of values.
+ * @return The log of the normalizer, log(sum(exp(values))), for computing the cross-entropy.
+ */
+double NeuralNetwork::softmax(double* values, int count) {
+    double maxValue = *std::max_element(values, values + count);
+    double sum = 0.0;
+    for (int i = 0; i < count; ++i) {
+        values[i] = std::exp(values[i] - maxValue);
+        sum += values[i];
+    }
+    double inverse = 1.0 / sum;
+    for (int i = 0; i < count; ++i) {
+        values[i] *= inverse;
+    }
+    return maxValue + std::log(sum);
 }
 
 // Constructor to initialize the neural network with specified layer sizes and learning rate
 NeuralNetwork::NeuralNetwork(int inputSize, int hiddenSize, int outputSize, double learningRate)
-    : inputSize(inputSize), hiddenSize(hiddenSize), outputSize(outputSize), learningRate(learningRate),
-    weights1(hiddenSize, inputSize), biases1(hiddenSize, 1), weights2(outputSize, hiddenSize), biases2(outputSize, 1)
+    : NeuralNetwork(std::vector<int>{inputSize, hiddenSize, outputSize}, learningRate) {}
+
+// Constructor taking over a ready stack of layers as they are: no random initialization and
+// no snapshot, e.g. for a temporary network that trains one layer of another.
+NeuralNetwork::NeuralNetwork(std::vector<DenseLayer> layerStack, double learningRate)
+    : inputSize(0), hiddenSize(0), outputSize(0), numThreads(omp_get_max_threads()), layers(std::move(layerStack)),
+    lossFunction(LossFunction::SquaredError), precision(Precision::Double),
+    validationSplit(0.0), earlyStoppingPatience(0), earlyStoppingMinDelta(0.0),
+    maxTrainingSeconds(0.0), maxTrainingSamples(0), snapshotInterval(0),
+    checkpointInterval(0), trainingCommand(IdleCommand), deterministic(false), seed(0),
+    sampleFraction(0.0), priorityExponent(1.0), priorityUniformMix(0.1), gradientClipNorm(0.0), replaySeen(0),
+    averageDecay(0.0), evaluateAverage(false), modelParallel(false), workspaceBatchSize(0)
+{
+    OptimizerConfig config;
+    config.learningRate = learningRate;
+    optimizer = Optimizer(config);
+    updateLayerSizes();
+    resetOptimizer();
+}
+
+// Function to create the layers of the network described by layerSizes
+std::vector<DenseLayer> NeuralNetwork::buildLayers(const std::vector<int>& layerSizes, Activation hiddenActivation) {
+    if (layerSizes.size() < 2) {
+        throw std::invalid_argument("A network needs an input size and at least one layer");
+    }
+    std::vector<DenseLayer> layerStack;
+    for (size_t l = 1; l < layerSizes.size(); ++l) {
+        bool isOutput = l + 1 == layerSizes.size();
+        layerStack.emplace_back(layerSizes[l - 1], layerSizes[l], isOutput ? Activation::Sigmoid : hiddenActivation);
+    }
+    return layerStack;
+}
+
+// Constructor to initialize a network with an arbitrary stack of dense layers.
+// layerSizes lists the input width followed by the width of every layer, e.g. {784, 128, 47}.
+// Hidden layers use hiddenActivation; the output layer's activation follows the loss function.
+NeuralNetwork::NeuralNetwork(const std::vector<int>& layerSizes, double learningRate, Activation hiddenActivation)
+    : NeuralNetwork(buildLayers(layerSizes, hiddenActivation), learningRate)
 {
     // Initialize weights and biases randomly
-    weights1.randomize(-1, 1);
-    biases1.randomize(-1, 1);
-    weights2.randomize(-1, 1);
-    biases2.randomize(-1, 1);
+    std::random_device rd;
+    std::mt19937 generator(rd());
+    initializeWeights(generator);
+    onlineRng.seed(rd());
+    publishSnapshot();
+}
+
+// Function to draw every layer's weights and biases from the range suited to its activation
+void NeuralNetwork::initializeWeights(std::mt19937& generator) {
+    for (DenseLayer& layer : layers) {
+        double range = layer.initializationRange();
+        layer.randomize(-range, range, generator);
+    }
+}
+
+/**
+ * @brief Switches reproducible training on or off.
+ *
+ * When enabled, the weights are re-initialized from the seed, the optimizer
+ * state and any interrupted run are cleared, and every train() call draws its
+ * validation split and epoch shuffles from the same seed. Per-sample work is
+ * independent of the thread that does it and all sums are taken in a fixed
+ * order, so the trained weights are bit-identical for any thread count.
+ * Like setLayerActivation, this is meant to be called right after construction
+ * (and after changing activations, which affect the initialization range).
+ *
+ * @param enabled Whether to train deterministically.
+ * @param newSeed The seed for the initial weights and the shuffles.
+ */
+void NeuralNetwork::setDeterministic(bool enabled, unsigned newSeed) {
+    deterministic = enabled;
+    seed = newSeed;
+    if (deterministic) {
+        std::mt19937 generator(seed);
+        initializeWeights(generator);
+        onlineRng.seed(seed);
+        resetOptimizer();
+        resetAverage();
+        resetTrainingState();
+        publishSnapshot();
+    }
+}
+
+bool NeuralNetwork::isDeterministic() const {
+    return deterministic;
+}
+
+/**
+ * @brief Switches trainBatch() between data-parallel and model-parallel execution.
+ *
+ * Data-parallel (the default) spreads the samples of a batch over the threads
+ * and computes every gradient row from all samples. Model-parallel gives every
+ * thread a slice of the hidden units instead: the rows of the first layer and
+ * the matching columns of the output layer stay with one thread for the
+ * forward pass, the backward pass and the update. The only data exchanged is
+ * the small batch x outputs array of partial output sums, which pays off for
+ * wide hidden layers whose weights no longer fit one core's cache.
+ *
+ * The output sums are added up per slice, so results depend on the thread
+ * count even in deterministic mode. The slices read the double master weights,
+ * so model-parallel training cannot be combined with a 16-bit storage precision.
+ *
+ * @param enabled Whether to train model-parallel.
+ * @throws std::invalid_argument If enabled for a network without exactly one hidden layer
+ *                               or with a 16-bit storage precision.
+ */
+void NeuralNetwork::setModelParallel(bool enabled) {
+    if (enabled && layers.size() != 2) {
+        throw std::invalid_argument("Model-parallel training needs exactly one hidden layer");
+    }
+    if (enabled && precision != Precision::Double) {
+        throw std::invalid_argument("Model-parallel training only supports double precision");
+    }
+    modelParallel = enabled;
+}
+
+bool NeuralNetwork::isModelParallel() const {
+    return modelParallel;
+}
+
+/**
+ * @brief Keeps an exponential moving average (EMA) of all weights and biases.
+ *
+ * After every optimizer step, average = decay * average + (1 - decay) * weights.
+ * The optimizer folds this into its update pass while each chunk of weights is
+ * still in cache, so the only extra memory traffic is the average itself. The
+ * average starts as a copy of the current weights and is always evaluated in
+ * double precision.
+ *
+ * With useForEvaluation, evaluate(), predict(), the inference snapshots, save()
+ * and the validation of train() (including the best weights it restores) use
+ * the average; training itself always continues from the raw weights.
+ *
+ * @param decay The weight of the old average per step, e.g. 0.999; 0 turns averaging off.
+ * @param useForEvaluation Whether the average replaces the raw weights for evaluation and saving.
+ */
+void NeuralNetwork::setWeightAveraging(double decay, bool useForEvaluation) {
+    averageDecay = std::min(std::max(decay, 0.0), 1.0);
+    evaluateAverage = useForEvaluation;
+    resetAverage();
+    publishSnapshot();
+}
+
+double NeuralNetwork::getWeightAveragingDecay() const {
+    return averageDecay;
+}
+
+// Function to get the layers used for evaluation and saving: the average if enabled for it, else the weights
+const std::vector<DenseLayer>& NeuralNetwork::getEvaluationLayers() const {
+    return evaluateAverage && !averageLayers.empty() ? averageLayers : layers;
+}
+
+// Function to restart the moving average from the current weights (or drop it when averaging is off)
+void NeuralNetwork::resetAverage() {
+    if (averageDecay <= 0.0) {
+        averageLayers.clear();
+        return;
+    }
+    averageLayers = layers;
+    for (DenseLayer& layer : averageLayers) {
+        layer.setStoragePrecision(Precision::Double);
+    }
+}
+
+// Function to refresh the cached input/hidden/output sizes after the layer stack changed
+void NeuralNetwork::updateLayerSizes() {
+    inputSize = layers.front().inputSize();
+    hiddenSize = layers.size() > 1 ? layers.front().outputSize() : 0;
+    outputSize = layers.back().outputSize();
+    workspaceBatchSize = 0;
+}
+
+// Function to (re)allocate the per-batch activation and error buffers.
+// Nothing is allocated when the batch size has not changed.
+void NeuralNetwork::reserveBatch(int batchSize) {
+    if (batchSize == workspaceBatchSize) {
+        return;
+    }
+    sampleLosses.assign(batchSize, 0.0);
+    sampleCorrect.assign(batchSize, 0);
+    gradientRowNorms.resize(layers.size());
+    activations.resize(layers.size());
+    deltas.resize(layers.size());
+    layerInputs.resize(layers.size());
+    weightGradients.resize(layers.size());
+    biasGradients.resize(layers.size());
+    for (size_t l = 0; l < layers.size(); ++l) {
+        activations[l].resize(batchSize, layers[l].outputSize());
+        deltas[l].resize(batchSize, layers[l].outputSize());
+        weightGradients[l].resize(layers[l].outputSize(), layers[l].inputSize());
+        biasGradients[l].resize(layers[l].outputSize(), 1);
+        gradientRowNorms[l].assign(layers[l].outputSize(), 0.0);
+
+        // Row pointers into the previous layer's activations; the first layer reads the batch directly
+        layerInputs[l].assign(batchSize, nullptr);
+        if (l > 0) {
+            for (int b = 0; b < batchSize; ++b) {
+                layerInputs[l][b] = activations[l - 1].data() + b * layers[l - 1].outputSize();
+            }
+        }
+    }
+    const int inputSize = layers.front().inputSize();
+    inputNonZeroIndices.resize(static_cast<size_t>(batchSize) * inputSize);
+    inputNonZeroValues.resize(static_cast<size_t>(batchSize) * inputSize);
+    inputNonZeroCounts.assign(batchSize, 0);
+    workspaceBatchSize = batchSize;
+}
+
+// Function to record the non-zero inputs of the sample in a slot of the batch
+void NeuralNetwork::collectNonZeroInputs(const double* input, int slot) {
+    const int inputSize = layers.front().inputSize();
+    int* indices = inputNonZeroIndices.data() + static_cast<size_t>(slot) * inputSize;
+    double* values = inputNonZeroValues.data() + static_cast<size_t>(slot) * inputSize;
+    int nonZeros = 0;
+    for (int i = 0; i < inputSize; ++i) {
+        if (input[i] != 0.0) {
+            indices[nonZeros] = i;
+            values[nonZeros] = input[i];
+            ++nonZeros;
+        }
+    }
+    inputNonZeroCounts[slot] = nonZeros;
+}
+
+// Function to describe the non-zero inputs collected for the current batch to the first layer
+SparseRows NeuralNetwork::sparseBatchInputs() const {
+    return { inputNonZeroIndices.data(), inputNonZeroValues.data(), inputNonZeroCounts.data(),
+             layers.front().inputSize() };
 }
 
 
 // Function to predict the output given an input vector
 std::vector<double> NeuralNetwork::predict(std::vector<double>& input)
 {
-    // Convert input to column vector and perform feedforward computation
-    MyMatrix inputMatrix(input);
-    MyMatrix hidden = weights1 * inputMatrix + biases1;
-    sigmoid(hidden);
-    MyMatrix output = weights2 * hidden + biases2;
-    sigmoid(output);
-
-    // Convert output to vector
-    return output.getColumnAsVector(0);
+    // Feed the input through every layer, ping-ponging between two buffers
+    std::vector<double> current(input);
+    std::vector<double> next;
+    for (const DenseLayer& layer : getEvaluationLayers()) {
+        next.resize(layer.outputSize());
+        layer.forward(current.data(), next.data());
+        current.swap(next);
+    }
+    if (lossFunction == LossFunction::SoftmaxCrossEntropy) {
+        softmax(current.data(), static_cast<int>(current.size()));
+    }
+    return current;
 }
 
 // Function to predict the output category given an input vector
@@ -87,100 +1027,761 @@ int NeuralNetwork::oneHotPredict(std::vector<double> &input) {
  * The function runs the training process over a specified number of epochs,
  * adjusting the network's weights and biases to minimize the error between
  * the network’s output and the target labels. The training data is shuffled
- * at the start of each epoch and is processed in mini-batches. The function
- * utilizes OpenMP for parallel processing of each input in the batch. The
- * backpropagation algorithm is used to calculate the error gradients and
- * update the weights and biases. Progress updates, including the error after
- * each epoch, are emitted as signals.
+ * at the start of each epoch and is processed in mini-batches; each mini-batch
+ * produces one averaged gradient which is handed to the configured optimizer
+ * (see setOptimizer). Progress updates, including the error after each epoch,
+ * are emitted as signals.
+ *
+ * If a validation split is set, that fraction of the data is held out and scored
+ * after every epoch; training then stops early once the accuracy stops improving
+ * (see setEarlyStopping) and the best weights are restored at the end. A time or
+ * sample budget (see setTrainingBudget) ends training at the next batch boundary.
+ *
+ * The progress of the run is kept in a TrainingState. With checkpointing enabled
+ * (see setCheckpointing) it is saved periodically together with the weights and
+ * optimizer state; after resumeFromCheckpoint() the next call with the same
+ * dataset and batch size picks up at the batch following the checkpoint.
+ *
+ * requestStop() and setPaused() control a running call from another thread. They
+ * are honoured between batches, so the weights are never left half-updated. A
+ * stopped run keeps its TrainingState and the next call continues it.
  *
  * @param inputs A vector of input vectors, each representing the features of a training example.
  * @param labels A vector of integers representing the target labels corresponding to the input vectors.
  * @param epochs The number of times the entire training dataset is processed.
- * @param errors A reference to a vector where the mean squared error is recorded every 5000 data points.
+ * @param errors A reference to a vector where the running mean loss of the current epoch is recorded
+ *               every 5000 data points. Per-batch loss, accuracy and gradient norm are available
+ *               through pollMetrics().
  * @param batchSize The number of training examples in each mini-batch.
  */
 void NeuralNetwork::train(std::vector<std::vector<double>>& inputs, std::vector<int>& labels, int epochs, std::vector<double>& errors, int batchSize) {
-    // Determine the number of inputs and batches
-    int numInputs = static_cast<int>(inputs.size());
-    int numBatches = (numInputs + batchSize - 1) / batchSize;
+    auto startTime = std::chrono::steady_clock::now();
+    TrainingState& state = trainingState;
+    int numSamples = static_cast<int>(inputs.size());
 
-    // Start the training loop for the specified number of epochs
-    for (int epoch = 0; epoch < epochs; ++epoch) {
-        double error = 0.0;
+    // Accept pause and stop requests only while this call runs, however it returns
+    struct ActiveGuard {
+        std::atomic<int>& command;
+        ~ActiveGuard() { command.store(IdleCommand); }
+    } activeGuard{ trainingCommand };
+    trainingCommand.store(RunCommand);
 
-        // 1. Shuffle dataset: Create a list of indices and shuffle them to randomize the input data for each epoch
-        std::vector<int> indices(numInputs);
-        std::iota(indices.begin(), indices.end(), 0);
+    // Start a new run unless an interrupted one on the same data is waiting to be continued
+    if (!state.active || state.numSamples != numSamples || state.batchSize != batchSize) {
         std::random_device rd;
-        std::mt19937 g(rd());
-        std::shuffle(indices.begin(), indices.end(), g);
+        state = TrainingState();
+        state.active = true;
+        state.batchSize = batchSize;
+        state.numSamples = numSamples;
+        state.rng.seed(deterministic ? seed : rd());
+
+        // Hold out a random validation subset; the remaining indices are used for training
+        std::vector<int> order(numSamples);
+        std::iota(order.begin(), order.end(), 0);
+        int numValidation = static_cast<int>(numSamples * validationSplit);
+        if (numValidation > 0) {
+            std::shuffle(order.begin(), order.end(), state.rng);
+        }
+        state.validationIndices.assign(order.end() - numValidation, order.end());
+        state.trainIndices.assign(order.begin(), order.end() - numValidation);
+    } else {
+        emit trainingProgress(QString("Resuming training at epoch %1, batch %2.").arg(state.epoch).arg(state.nextBatch));
+    }
+    std::vector<int>& indices = state.trainIndices;
+    if (sampleFraction > 0.0 && state.sampleLoss.size() != inputs.size()) {
+        state.sampleLoss.assign(inputs.size(), 0.0);
+    }
+    reserveBatch(batchSize);
+    BatchLoader loader(inputs, labels, batchSize);
+    long long samplesAtStart = state.samplesSeen;
+    bool budgetExhausted = false;
+    bool stopped = false;
+
+    // Start the training loop for the specified number of epochs
+    while (state.epoch < epochs && !budgetExhausted) {
+        if (stopRequested()) {
+            stopped = true;
+            break;
+        }
+
+        // 1. Shuffle dataset: Shuffle the training indices to randomize the input data for each epoch.
+        // A resumed epoch keeps the order it was checkpointed with.
+        currentStats = EpochStats();
+        double epochStart = omp_get_wtime();
+        // With prioritized sampling, every epoch after the first draws its samples by loss instead.
+        if (state.nextBatch == 0) {
+            state.epochError = 0.0;
+            if (sampleFraction > 0.0 && state.epoch > 0) {
+                samplePrioritizedOrder();
+            } else {
+                state.epochOrder.clear();
+                std::shuffle(indices.begin(), indices.end(), state.rng);
+            }
+        }
+        currentStats.shuffleSeconds = omp_get_wtime() - epochStart;
+
+        // Determine the number of inputs and batches of this epoch
+        const std::vector<int>& order = state.epochOrder.empty() ? indices : state.epochOrder;
+        int numInputs = static_cast<int>(order.size());
+        int numBatches = (numInputs + batchSize - 1) / batchSize;
+
+        // The loader gathers the next batch into a contiguous buffer while the current one trains
+        loader.startEpoch(order, state.nextBatch);
 
         // Loop over each batch
-        for (int b = 0; b < numBatches; ++b) {
-            int start = b * batchSize;
+        while (state.nextBatch < numBatches) {
+            int start = state.nextBatch * batchSize;
             int end = std::min(start + batchSize, numInputs);
 
-            // Parallelize the processing of each input in the batch using OpenMP
-#pragma omp parallel for reduction(+:error) num_threads(numThreads)
-            for (int i = start; i < end; ++i) {
-                int idx = indices[i]; // Using the shuffled index
-
-                // Forward pass: Compute the output of the network given the input
-                MyMatrix inputMatrix(inputs[idx]);
-                MyMatrix hidden = weights1 * inputMatrix + biases1;
-                sigmoid(hidden);
-                MyMatrix output = weights2 * hidden + biases2;
-                sigmoid(output);
-
-                // Setup target matrix: Initialize it with zeros and set the corresponding label index to 1
-                MyMatrix targetMatrix(output.rows(), 1);
-                targetMatrix.setAll(0);
-                targetMatrix(labels[idx], 0) = 1;
-
-                // Calculate output error: Difference between the network's output and the target
-                MyMatrix outputErrorMatrix = output - targetMatrix;
-
-                // Compute squared error for the current input and accumulate it
-                double currentError = outputErrorMatrix.elementWiseProduct(outputErrorMatrix).sum();
-                error += currentError;
-
-                // Backpropagation: Compute the error for the hidden layer and the gradients for weights and biases
-                MyMatrix hiddenError = weights2.transpose() * outputErrorMatrix;
-                MyMatrix hiddenGradient = hidden.elementWiseProduct(MyMatrix::allOnes(hidden.rows(), hidden.columns()) - hidden).elementWiseProduct(hiddenError);
-
-                MyMatrix weights2Delta = outputErrorMatrix * hidden.transpose();
-                MyMatrix biases2Delta = outputErrorMatrix;
-
-                MyMatrix weights1Delta = hiddenGradient * inputMatrix.transpose();
-                MyMatrix biases1Delta = hiddenGradient;
-
-                // Update weights and biases using the computed gradients and the learning rate
-                weights2 -= weights2Delta * learningRate;
-                biases2 -= biases2Delta * learningRate;
-                weights1 -= weights1Delta * learningRate;
-                biases1 -= biases1Delta * learningRate;
-
-                // Log progress: Record the mean squared error every 5000 datapoints
-                if (i % 5000 == 0 && i != 0) {
-                    errors.push_back(error / i);
+            // Take the gathered batch; the time spent waiting for it is the gather stall
+            double gatherStart = omp_get_wtime();
+            BatchLoader::Batch batch;
+            loader.next(batch);
+            currentStats.gatherSeconds += omp_get_wtime() - gatherStart;
+            currentStats.samples += batch.count;
+            state.epochError += trainBatch(batch.inputs, batch.labels, batch.count);
+            if (sampleFraction > 0.0) {
+                // Refresh the loss index with the losses the forward pass just measured
+                for (int b = 0; b < batch.count; ++b) {
+                    state.sampleLoss[batch.indices[b]] = sampleLosses[b];
                 }
             }
+            state.samplesSeen += end - start;
+            ++state.nextBatch;
+            if (snapshotInterval > 0 && state.nextBatch % snapshotInterval == 0) {
+                publishSnapshot();
+            }
+            if (checkpointInterval > 0 && state.nextBatch % checkpointInterval == 0 && state.nextBatch < numBatches) {
+                saveCheckpoint();
+            }
+
+            // Log progress: Record the mean loss every 5000 datapoints
+            if (end / 5000 != start / 5000) {
+                errors.push_back(state.epochError / end);
+            }
+
+            // Stop or pause on request; the position after this batch is kept in the training state
+            if (stopRequested()) {
+                stopped = true;
+                break;
+            }
+
+            // Stop as soon as the wall-clock or sample budget is used up
+            double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+            if ((maxTrainingSeconds > 0.0 && elapsed >= maxTrainingSeconds) ||
+                (maxTrainingSamples > 0 && state.samplesSeen - samplesAtStart >= maxTrainingSamples)) {
+                budgetExhausted = true;
+                break;
+            }
+        }
+
+        if (stopped) {
+            break;
         }
 
         // Compute the mean error for this epoch and emit signals for progress update
-        error /= numInputs;
+        int processed = std::min(state.nextBatch * batchSize, numInputs);
+        double error = state.epochError / std::max(processed, 1);
+        int epoch = state.epoch++;
+        state.nextBatch = 0;
         QString updateMessage = QString("Training Epoch %1 completed. Current error: %2").arg(epoch).arg(error);
+
+        // Score the held-out set and remember the best weights seen so far
+        if (!state.validationIndices.empty()) {
+            double validationStart = omp_get_wtime();
+            double accuracy = evaluate(inputs, labels, state.validationIndices);
+            currentStats.validationSeconds = omp_get_wtime() - validationStart;
+            if (accuracy > state.bestAccuracy + earlyStoppingMinDelta) {
+                state.bestAccuracy = accuracy;
+                state.bestLayers = getEvaluationLayers();
+                state.epochsWithoutImprovement = 0;
+            } else {
+                ++state.epochsWithoutImprovement;
+            }
+            updateMessage += QString(" Validation accuracy: %1%").arg(accuracy * 100.0);
+            emit validationReported(accuracy);
+        }
+        publishSnapshot();
+
+        // Throughput of the training part of the epoch, without validation
+        currentStats.epoch = epoch;
+        currentStats.seconds = omp_get_wtime() - epochStart - currentStats.validationSeconds;
+        if (currentStats.seconds > 0.0) {
+            currentStats.samplesPerSecond = currentStats.samples / currentStats.seconds;
+            currentStats.gflops = currentStats.samples * flopsPerSample() / currentStats.seconds * 1e-9;
+        }
+        lastEpochStats = currentStats;
         emit trainingProgress(updateMessage);
         emit epochUpdates(epoch);
         emit errorReported(error);
+        emit epochStatsReported(lastEpochStats);
+
+        if (earlyStoppingPatience > 0 && state.epochsWithoutImprovement >= earlyStoppingPatience) {
+            emit trainingProgress(QString("Early stopping after epoch %1: no improvement for %2 epochs.")
+                                      .arg(epoch).arg(state.epochsWithoutImprovement));
+            break;
+        }
+
+        // The checkpoint points at the start of the next epoch
+        if (state.epoch < epochs && !budgetExhausted) {
+            saveCheckpoint();
+        }
+    }
+
+    // A stopped run stays active with its current weights, so the next train() call continues it
+    if (stopped) {
+        saveCheckpoint();
+        publishSnapshot();
+        emit trainingProgress(QString("Training stopped at epoch %1, batch %2.").arg(state.epoch).arg(state.nextBatch));
+        return;
+    }
+
+    if (budgetExhausted) {
+        emit trainingProgress(QString("Training budget exhausted after %1 samples.").arg(state.samplesSeen - samplesAtStart));
+    }
+    if (!state.bestLayers.empty()) {
+        layers = state.bestLayers;
+        setPrecision(precision);
+        resetAverage();
+    }
+
+    // The run is complete; the final checkpoint only carries the finished weights
+    state = TrainingState();
+    saveCheckpoint();
+    publishSnapshot();
+}
+
+// Function to compute the classification accuracy on a whole dataset
+double NeuralNetwork::evaluate(const std::vector<std::vector<double>>& inputs, const std::vector<int>& labels) {
+    std::vector<int> indices(inputs.size());
+    std::iota(indices.begin(), indices.end(), 0);
+    return evaluate(inputs, labels, indices);
+}
+
+/**
+ * @brief Computes the classification accuracy on a subset of a dataset.
+ *
+ * Samples are classified in blocks with DenseLayer::forwardBatch, so every
+ * weight row is loaded once per block instead of once per sample. Blocks are
+ * distributed over OpenMP threads, each with its own pair of activation buffers;
+ * the training buffers are not touched.
+ *
+ * @param inputs The dataset's input vectors.
+ * @param labels The dataset's target labels.
+ * @param indices The indices of the samples to score.
+ * @return The fraction of the selected samples that are classified correctly.
+ */
+double NeuralNetwork::evaluate(const std::vector<std::vector<double>>& inputs, const std::vector<int>& labels,
+                               const std::vector<int>& indices) {
+    const int blockSize = 64;
+    const int count = static_cast<int>(indices.size());
+    if (count == 0) {
+        return 0.0;
+    }
+    const std::vector<DenseLayer>& evaluationLayers = getEvaluationLayers();
+    int widest = 0;
+    for (const DenseLayer& layer : evaluationLayers) {
+        widest = std::max(widest, layer.outputSize());
+    }
+    int correct = 0;
+
+#pragma omp parallel num_threads(numThreads) reduction(+:correct)
+    {
+        std::vector<double> current(blockSize * widest);
+        std::vector<double> next(blockSize * widest);
+        std::vector<const double*> rows(blockSize);
+
+#pragma omp for schedule(static)
+        for (int start = 0; start < count; start += blockSize) {
+            int n = std::min(blockSize, count - start);
+            for (int b = 0; b < n; ++b) {
+                rows[b] = inputs[indices[start + b]].data();
+            }
+            for (const DenseLayer& layer : evaluationLayers) {
+                layer.forwardBatch(rows.data(), n, next.data());
+                current.swap(next);
+                for (int b = 0; b < n; ++b) {
+                    rows[b] = current.data() + b * layer.outputSize();
+                }
+            }
+            for (int b = 0; b < n; ++b) {
+                const double* output = rows[b];
+                int guess = static_cast<int>(std::max_element(output, output + outputSize) - output);
+                if (guess == labels[indices[start + b]]) {
+                    ++correct;
+                }
+            }
+        }
+    }
+    return static_cast<double>(correct) / count;
+}
+
+// Function to turn the output layer's activations of one sample into the network's output
+// (probabilities for cross-entropy), write the error at the output layer and return the loss
+double NeuralNetwork::computeOutputError(double* output, double* outputError, int label) const {
+    double currentError = 0.0;
+    if (lossFunction == LossFunction::SoftmaxCrossEntropy) {
+        // Cross-entropy of the softmax: log-sum-exp minus the target logit. The gradient
+        // with respect to the logits is (probabilities - one-hot); it is written in the same
+        // pass that normalizes the probabilities, so no target vector is ever built.
+        double targetLogit = output[label];
+        double maxLogit = *std::max_element(output, output + outputSize);
+        double sum = 0.0;
+        for (int o = 0; o < outputSize; ++o) {
+            output[o] = std::exp(output[o] - maxLogit);
+            sum += output[o];
+        }
+        double inverse = 1.0 / sum;
+        for (int o = 0; o < outputSize; ++o) {
+            double probability = output[o] * inverse;
+            output[o] = probability;
+            outputError[o] = probability;
+        }
+        outputError[label] -= 1.0;
+        currentError = maxLogit + std::log(sum) - targetLogit;
+    } else {
+        for (int o = 0; o < outputSize; ++o) {
+            outputError[o] = output[o] - (o == label ? 1.0 : 0.0);
+            currentError += outputError[o] * outputError[o];
+        }
+    }
+    return currentError;
+}
+
+/**
+ * @brief Runs forward and backward passes for one mini-batch and applies one optimizer step.
+ *
+ * @param batchInputs One pointer per sample to its input vector (inputSize values).
+ * @param batchLabels The target class of every sample.
+ * @param count The number of samples in the batch.
+ * @return The summed loss of the batch (squared error or cross-entropy), measured before the update.
+ */
+double NeuralNetwork::trainBatch(const double* const* batchInputs, const int* batchLabels, int count) {
+    if (modelParallel && layers.size() == 2) {
+        return trainBatchModelParallel(batchInputs, batchLabels, count);
+    }
+    double error = computeGradients(batchInputs, batchLabels, count);
+    applyGradients();
+    return error;
+}
+
+/**
+ * @brief Runs forward and backward passes for one mini-batch and leaves its mean gradient in the gradient buffers.
+ *
+ * Samples are distributed over the OpenMP team; each one owns a row (slot) of
+ * the preallocated activation and error buffers. The gradient of every layer is
+ * then computed row-parallel in the same parallel region. No parameter changes
+ * until applyGradients(), so gradients of several replicas can be combined
+ * through getWeightGradient() and getBiasGradient() in between.
+ *
+ * @param batchInputs One pointer per sample to its input vector (inputSize values).
+ * @param batchLabels The target class of every sample.
+ * @param count The number of samples in the batch.
+ * @return The summed loss of the batch (squared error or cross-entropy).
+ */
+double NeuralNetwork::computeGradients(const double* const* batchInputs, const int* batchLabels, int count) {
+    if (count > workspaceBatchSize) {
+        reserveBatch(count);
+    }
+    const int numLayers = static_cast<int>(layers.size());
+    double forwardTime = 0.0;
+    double backwardTime = 0.0;
+    double passEnd = 0.0;
+    double passStart = omp_get_wtime();
+
+#pragma omp parallel num_threads(numThreads)
+    {
+#pragma omp for reduction(+:forwardTime, backwardTime) schedule(static)
+        for (int slot = 0; slot < count; ++slot) {
+            // Forward pass: Compute the activation of every layer given the input
+            double sampleStart = omp_get_wtime();
+            const double* layerInput = batchInputs[slot];
+            collectNonZeroInputs(layerInput, slot);
+            for (int l = 0; l < numLayers; ++l) {
+                double* layerOutput = activations[l].data() + slot * layers[l].outputSize();
+                layers[l].forward(layerInput, layerOutput);
+                layerInput = layerOutput;
+            }
+
+            double forwardEnd = omp_get_wtime();
+            forwardTime += forwardEnd - sampleStart;
+
+            // Calculate output error: Difference between the network's output and the one-hot target
+            double* output = activations[numLayers - 1].data() + slot * outputSize;
+            double* outputError = deltas[numLayers - 1].data() + slot * outputSize;
+            const int label = batchLabels[slot];
+            sampleLosses[slot] = computeOutputError(output, outputError, label);
+            sampleCorrect[slot] = std::max_element(output, output + outputSize) - output == label;
+
+            // Backpropagation: Push the error through every hidden layer and apply its activation derivative
+            for (int l = numLayers - 1; l > 0; --l) {
+                const int width = layers[l - 1].outputSize();
+                const double* hidden = activations[l - 1].data() + slot * width;
+                double* hiddenError = deltas[l - 1].data() + slot * width;
+                layers[l].backward(deltas[l].data() + slot * layers[l].outputSize(), hiddenError);
+                layers[l - 1].applyDerivative(hidden, hiddenError, width);
+            }
+            backwardTime += omp_get_wtime() - forwardEnd;
+        }
+#pragma omp master
+        passEnd = omp_get_wtime();
+
+        // Gradients: the first layer reads the batch inputs and skips their zeros,
+        // every other layer reads the previous activations
+        const SparseRows sparseInputs = sparseBatchInputs();
+        for (int l = 0; l < numLayers; ++l) {
+            const double* const* layerIn = l == 0 ? batchInputs : layerInputs[l].data();
+            layers[l].gradient(layerIn, deltas[l].data(), count, weightGradients[l], biasGradients[l],
+                               gradientRowNorms[l].data(), l == 0 ? &sparseInputs : nullptr);
+        }
+    }
+
+    // Merge the per-slot and per-row results in a fixed order so they do not depend on the threads
+    double error = 0.0;
+    int correct = 0;
+    for (int slot = 0; slot < count; ++slot) {
+        error += sampleLosses[slot];
+        correct += sampleCorrect[slot];
+    }
+    double squaredNorm = 0.0;
+    for (int l = 0; l < numLayers; ++l) {
+        for (double rowNorm : gradientRowNorms[l]) {
+            squaredNorm += rowNorm;
+        }
+    }
+    pendingMetrics.epoch = trainingState.epoch;
+    pendingMetrics.samples = count;
+    pendingMetrics.loss = error / count;
+    pendingMetrics.accuracy = static_cast<double>(correct) / count;
+    pendingMetrics.gradientNorm = std::sqrt(squaredNorm);
+
+    // Split the wall time of the per-sample pass in the ratio of the summed thread times
+    double gradientEnd = omp_get_wtime();
+    double passTime = passEnd - passStart;
+    double threadTime = forwardTime + backwardTime;
+    double forwardShare = threadTime > 0.0 ? forwardTime / threadTime : 0.5;
+    currentStats.forwardSeconds += passTime * forwardShare;
+    currentStats.backwardSeconds += passTime * (1.0 - forwardShare) + (gradientEnd - passEnd);
+    return error;
+}
+
+/**
+ * @brief Applies one optimizer step with the gradients left by computeGradients().
+ *
+ * Every parameter tensor is updated in one fused pass. While learnOnline() runs,
+ * a gradient whose norm exceeds its clipping bound is scaled down inside that pass.
+ *
+ * @param squaredNorm The squared L2 norm of the gradients. A negative value keeps the norm
+ *        measured by computeGradients(); pass the new norm after combining gradient buffers.
+ */
+void NeuralNetwork::applyGradients(double squaredNorm) {
+    const int numLayers = static_cast<int>(layers.size());
+    double updateStart = omp_get_wtime();
+    if (squaredNorm >= 0.0) {
+        pendingMetrics.gradientNorm = std::sqrt(squaredNorm);
+    }
+    double gradientScale = 1.0;
+    if (gradientClipNorm > 0.0 && pendingMetrics.gradientNorm > gradientClipNorm) {
+        gradientScale = gradientClipNorm / pendingMetrics.gradientNorm;
+    }
+    optimizer.beginStep();
+
+#pragma omp parallel num_threads(numThreads)
+    {
+        // Update weights and biases with one fused pass per parameter tensor
+        for (int l = 0; l < numLayers; ++l) {
+            MyMatrix& weights = layers[l].weights();
+            MyMatrix& biases = layers[l].biases();
+            double* weightAverage = averageLayers.empty() ? nullptr : averageLayers[l].weights().data();
+            double* biasAverage = averageLayers.empty() ? nullptr : averageLayers[l].biases().data();
+            optimizer.step(2 * l, weights.data(), weightGradients[l].data(), weights.rows() * weights.columns(),
+                           gradientScale, weightAverage, averageDecay);
+            optimizer.step(2 * l + 1, biases.data(), biasGradients[l].data(), biases.rows(), gradientScale,
+                           biasAverage, averageDecay);
+        }
+
+        // Re-encode the 16-bit weight copies read by the next forward pass (no-op in double precision)
+        for (int l = 0; l < numLayers; ++l) {
+            layers[l].refreshLowPrecisionWeights();
+        }
+    }
+
+    // Publish the step for pollMetrics()
+    pendingMetrics.step = optimizer.stepCount();
+    metrics.push(pendingMetrics);
+    currentStats.updateSeconds += omp_get_wtime() - updateStart;
+}
+
+/**
+ * @brief Trains one mini-batch with the hidden units partitioned over the threads.
+ *
+ * Thread t owns hidden units [H*t/T, H*(t+1)/T): it computes their activations,
+ * their share of every output pre-activation, their errors, the matching rows
+ * of the first layer's gradient and columns of the output layer's gradient,
+ * and applies the optimizer to exactly those parameters. Between the forward
+ * and the backward pass the T partial output sums of every sample are added up
+ * (the all-gather); the gradient norm is the only other value combined.
+ *
+ * @param batchInputs One pointer per sample to its input vector (inputSize values).
+ * @param batchLabels The target class of every sample.
+ * @param count The number of samples in the batch.
+ * @return The summed loss of the batch, measured before the update.
+ */
+double NeuralNetwork::trainBatchModelParallel(const double* const* batchInputs, const int* batchLabels, int count) {
+    if (count > workspaceBatchSize) {
+        reserveBatch(count);
+    }
+    DenseLayer& hiddenLayer = layers[0];
+    DenseLayer& outputLayer = layers[1];
+    const int hidden = hiddenLayer.outputSize();
+    const int teamSize = std::max(1, std::min(numThreads, hidden));
+    partialOutputs.resize(static_cast<size_t>(teamSize) * count * outputSize);
+    sliceSquaredNorms.assign(teamSize, 0.0);
+    double passStart = omp_get_wtime();
+    double forwardEnd = 0.0;
+    double backwardEnd = 0.0;
+    double gradientScale = 1.0;
+    optimizer.beginStep();
+
+#pragma omp parallel num_threads(teamSize)
+    {
+        const int threads = omp_get_num_threads();
+        const int thread = omp_get_thread_num();
+        const int begin = hidden * thread / threads;
+        const int end = hidden * (thread + 1) / threads;
+        const double* w2 = outputLayer.weights().data();
+        double* partial = partialOutputs.data() + static_cast<size_t>(thread) * count * outputSize;
+
+        // Forward pass of the slice: its hidden activations and its share of every output
+        for (int b = 0; b < count; ++b) {
+            double* h = activations[0].data() + b * hidden;
+            hiddenLayer.forwardRows(batchInputs[b], h, begin, end);
+            double* p = partial + b * outputSize;
+            for (int o = 0; o < outputSize; ++o) {
+                const double* row = w2 + o * hidden;
+                double sum = 0.0;
+                for (int j = begin; j < end; ++j) {
+                    sum += row[j] * h[j];
+                }
+                p[o] = sum;
+            }
+        }
+#pragma omp barrier
+
+        // All-gather: add up the partial outputs in slice order, then the loss and output error
+#pragma omp for schedule(static)
+        for (int b = 0; b < count; ++b) {
+            double* output = activations[1].data() + b * outputSize;
+            double* outputError = deltas[1].data() + b * outputSize;
+            const double* bias = outputLayer.biases().data();
+            for (int o = 0; o < outputSize; ++o) {
+                output[o] = bias[o];
+            }
+            for (int t = 0; t < threads; ++t) {
+                const double* p = partialOutputs.data() + (static_cast<size_t>(t) * count + b) * outputSize;
+                for (int o = 0; o < outputSize; ++o) {
+                    output[o] += p[o];
+                }
+            }
+            outputLayer.activate(output);
+            sampleLosses[b] = computeOutputError(output, outputError, batchLabels[b]);
+            collectNonZeroInputs(batchInputs[b], b);
+            sampleCorrect[b] = std::max_element(output, output + outputSize) - output == batchLabels[b];
+        }
+#pragma omp master
+        forwardEnd = omp_get_wtime();
+
+        // Backward pass of the slice: errors of its hidden units
+        for (int b = 0; b < count; ++b) {
+            const double* outputError = deltas[1].data() + b * outputSize;
+            double* hiddenError = deltas[0].data() + b * hidden;
+            for (int j = begin; j < end; ++j) {
+                hiddenError[j] = 0.0;
+            }
+            for (int o = 0; o < outputSize; ++o) {
+                const double* row = w2 + o * hidden;
+                const double d = outputError[o];
+                for (int j = begin; j < end; ++j) {
+                    hiddenError[j] += row[j] * d;
+                }
+            }
+            hiddenLayer.applyDerivative(activations[0].data() + b * hidden + begin, hiddenError + begin, end - begin);
+        }
+
+        // Gradients of the slice: rows of the first layer, columns of the output layer
+        const SparseRows sparseInputs = sparseBatchInputs();
+        hiddenLayer.gradientRows(batchInputs, deltas[0].data(), count, weightGradients[0], biasGradients[0],
+                                 gradientRowNorms[0].data(), begin, end, &sparseInputs);
+        double* g2 = weightGradients[1].data();
+        const double scale = 1.0 / count;
+        for (int o = 0; o < outputSize; ++o) {
+            double* row = g2 + o * hidden;
+            for (int j = begin; j < end; ++j) {
+                row[j] = 0.0;
+            }
+        }
+        for (int b = 0; b < count; ++b) {
+            const double* h = activations[0].data() + b * hidden;
+            const double* outputError = deltas[1].data() + b * outputSize;
+            for (int o = 0; o < outputSize; ++o) {
+                double* row = g2 + o * hidden;
+                const double d = outputError[o];
+                for (int j = begin; j < end; ++j) {
+                    row[j] += d * h[j];
+                }
+            }
+        }
+        double squaredNorm = 0.0;
+        for (int j = begin; j < end; ++j) {
+            squaredNorm += gradientRowNorms[0][j];
+        }
+        for (int o = 0; o < outputSize; ++o) {
+            double* row = g2 + o * hidden;
+            for (int j = begin; j < end; ++j) {
+                row[j] *= scale;
+                squaredNorm += row[j] * row[j];
+            }
+        }
+
+        // The output biases are shared by all slices; the first thread owns them
+        if (thread == 0) {
+            double* gb2 = biasGradients[1].data();
+            for (int o = 0; o < outputSize; ++o) {
+                double sum = 0.0;
+                for (int b = 0; b < count; ++b) {
+                    sum += deltas[1].data()[b * outputSize + o];
+                }
+                gb2[o] = sum * scale;
+                squaredNorm += gb2[o] * gb2[o];
+            }
+        }
+        sliceSquaredNorms[thread] = squaredNorm;
+#pragma omp barrier
+
+        // Combine the slice norms in a fixed order for the metrics and optional clipping
+#pragma omp master
+        {
+            backwardEnd = omp_get_wtime();
+            double total = 0.0;
+            for (double norm : sliceSquaredNorms) {
+                total += norm;
+            }
+            pendingMetrics.gradientNorm = std::sqrt(total);
+            if (gradientClipNorm > 0.0 && pendingMetrics.gradientNorm > gradientClipNorm) {
+                gradientScale = gradientClipNorm / pendingMetrics.gradientNorm;
+            }
+        }
+#pragma omp barrier
+
+        // Update the slice's own parameters (and their moving average, if kept)
+        const int inputs = hiddenLayer.inputSize();
+        const bool averaging = !averageLayers.empty();
+        double* average[4] = { nullptr, nullptr, nullptr, nullptr };
+        if (averaging) {
+            average[0] = averageLayers[0].weights().data();
+            average[1] = averageLayers[0].biases().data();
+            average[2] = averageLayers[1].weights().data();
+            average[3] = averageLayers[1].biases().data();
+        }
+        optimizer.stepRange(0, hiddenLayer.weights().data(), weightGradients[0].data(), begin * inputs, end * inputs,
+                            gradientScale, average[0], averageDecay);
+        optimizer.stepRange(1, hiddenLayer.biases().data(), biasGradients[0].data(), begin, end, gradientScale,
+                            average[1], averageDecay);
+        for (int o = 0; o < outputSize; ++o) {
+            optimizer.stepRange(2, outputLayer.weights().data(), weightGradients[1].data(), o * hidden + begin,
+                                o * hidden + end, gradientScale, average[2], averageDecay);
+        }
+        if (thread == 0) {
+            optimizer.stepRange(3, outputLayer.biases().data(), biasGradients[1].data(), 0, outputSize, gradientScale,
+                                average[3], averageDecay);
+        }
+#pragma omp barrier
+
+        // Re-encode the 16-bit weight copies read by the next forward pass (no-op in double precision)
+        hiddenLayer.refreshLowPrecisionWeights();
+        outputLayer.refreshLowPrecisionWeights();
+    }
+
+    // Merge the per-sample results in a fixed order and publish the step for pollMetrics()
+    double error = 0.0;
+    int correct = 0;
+    for (int b = 0; b < count; ++b) {
+        error += sampleLosses[b];
+        correct += sampleCorrect[b];
     }
+    pendingMetrics.epoch = trainingState.epoch;
+    pendingMetrics.samples = count;
+    pendingMetrics.loss = error / count;
+    pendingMetrics.accuracy = static_cast<double>(correct) / count;
+    pendingMetrics.step = optimizer.stepCount();
+    metrics.push(pendingMetrics);
+
+    currentStats.forwardSeconds += forwardEnd - passStart;
+    currentStats.backwardSeconds += backwardEnd - forwardEnd;
+    currentStats.updateSeconds += omp_get_wtime() - backwardEnd;
+    return error;
 }
 
+// Function to turn this network into a replica of another one: same layers, loss,
+// precision and optimizer state. The copies are allocated by the calling thread.
+void NeuralNetwork::copyParametersFrom(const NeuralNetwork& other) {
+    if (&other == this) {
+        return;
+    }
+    if (modelParallel && other.precision != Precision::Double) {
+        throw std::invalid_argument("Model-parallel training only supports double precision");
+    }
+    layers = other.layers;
+    lossFunction = other.lossFunction;
+    optimizer = other.optimizer;
+    averageDecay = other.averageDecay;
+    evaluateAverage = other.evaluateAverage;
+    averageLayers = other.averageLayers;
+    updateLayerSizes();
+    setPrecision(other.precision);
+    publishSnapshot();
+}
 
+// Function to get the number of weights and biases of all layers
+std::size_t NeuralNetwork::parameterCount() const {
+    std::size_t count = 0;
+    for (const DenseLayer& layer : layers) {
+        count += static_cast<std::size_t>(layer.outputSize()) * (layer.inputSize() + 1);
+    }
+    return count;
+}
 
+// Function to copy all parameters into one flat array (per layer: weights row by row, then biases)
+void NeuralNetwork::getParameters(double* out) const {
+    for (const DenseLayer& layer : layers) {
+        out = std::copy(layer.weights().data(), layer.weights().data() + layer.outputSize() * layer.inputSize(), out);
+        out = std::copy(layer.biases().data(), layer.biases().data() + layer.outputSize(), out);
+    }
+}
 
+// Function to overwrite all parameters from a flat array in the layout of getParameters()
+void NeuralNetwork::setParameters(const double* values) {
+    for (DenseLayer& layer : layers) {
+        const int weightCount = layer.outputSize() * layer.inputSize();
+        std::copy(values, values + weightCount, layer.weights().data());
+        values += weightCount;
+        std::copy(values, values + layer.outputSize(), layer.biases().data());
+        values += layer.outputSize();
+        layer.refreshLowPrecisionWeights();
+    }
+    resetAverage();
+    publishSnapshot();
+}
 
+// Function to access the mean weight gradient of a layer left by computeGradients()
+MyMatrix& NeuralNetwork::getWeightGradient(int index) {
+    return weightGradients.at(index);
+}
 
+// Function to access the mean bias gradient of a layer left by computeGradients()
+MyMatrix& NeuralNetwork::getBiasGradient(int index) {
+    return biasGradients.at(index);
+}
 
 // Function to apply the sigmoid function to all elements of the matrix
 void NeuralNetwork::sigmoid(MyMatrix& matrix)
@@ -193,40 +1794,23 @@ void NeuralNetwork::sigmoid(MyMatrix& matrix)
 }
 
 ////Serialization:
-// Function to save the neural network parameters to a file
+// Function to save the neural network parameters to a file.
+// Every layer is written as its weight matrix followed by its bias vector,
+// so a 784-128-47 network produces the same file layout as before.
 
 void NeuralNetwork::save(const std::string& filename) const {
     std::ofstream file(filename);
-     // Writing weights and biases matrices to the file
-    // Serialize weights1
-    file << weights1.rows() << " " << weights1.columns() << "\n";
-    for (int i = 0; i < weights1.rows(); ++i) {
-        for (int j = 0; j < weights1.columns(); ++j) {
-            file << weights1(i, j) << " ";
-        }
-        file << "\n";
-    }
-    file << biases1.rows() << " " << biases1.columns() << "\n";
-    for (int i = 0; i < biases1.rows(); ++i) {
-        for (int j = 0; j < biases1.columns(); ++j) {
-            file << biases1(i, j) << " ";
-        }
-        file << "\n";
-    }
-    file << weights2.rows() << " " << weights2.columns() << "\n";
-    for (int i = 0; i < weights2.rows(); ++i) {
-        for (int j = 0; j < weights2.columns(); ++j) {
-            file << weights2(i, j) << " ";
-        }
-        file << "\n";
-    }
-
-    file << biases2.rows() << " " << biases2.columns() << "\n";
-    for (int i = 0; i < biases2.rows(); ++i) {
-        for (int j = 0; j < biases2.columns(); ++j) {
-            file << biases2(i, j) << " ";
+    for (const DenseLayer& layer : getEvaluationLayers()) {
+        const MyMatrix* matrices[] = { &layer.weights(), &layer.biases() };
+        for (const MyMatrix* matrix : matrices) {
+            file << matrix->rows() << " " << matrix->columns() << "\n";
+            for (int i = 0; i < matrix->rows(); ++i) {
+                for (int j = 0; j < matrix->columns(); ++j) {
+                    file << (*matrix)(i, j) << " ";
+                }
+                file << "\n";
+            }
         }
-        file << "\n";
     }
 
     file.close();
@@ -235,41 +1819,53 @@ void NeuralNetwork::save(const std::string& filename) const {
 
 //
 ////Deserialization
-// Function to load the neural network parameters from a file
+// Function to load the neural network parameters from a file.
+// The layer stack is rebuilt from however many weight/bias pairs the file contains;
+// activation functions are not stored and are taken over from the current network.
 void NeuralNetwork::load(const std::string& filename) {
-    // Reading weights and biases matrices from the file
     std::ifstream file(filename);
+    if (!file) {
+        throw std::runtime_error("Error opening model file");
+    }
+    std::vector<DenseLayer> loaded;
     int rows, cols;
 
-    // Deserialize weights1
-    file >> rows >> cols;
-    weights1.resize(rows, cols);
-    for (int i = 0; i < rows; ++i) {
-        for (int j = 0; j < cols; ++j) {
-            file >> weights1(i, j);
+    while (file >> rows >> cols) {
+        MyMatrix weights(rows, cols);
+        for (int i = 0; i < rows; ++i) {
+            for (int j = 0; j < cols; ++j) {
+                file >> weights(i, j);
+            }
         }
-    }
-    file >> rows >> cols;
-    biases1.resize(rows, cols);
-    for (int i = 0; i < rows; ++i) {
-        for (int j = 0; j < cols; ++j) {
-            file >> biases1(i, j);
+        file >> rows >> cols;
+        MyMatrix biases(rows, cols);
+        for (int i = 0; i < rows; ++i) {
+            for (int j = 0; j < cols; ++j) {
+                file >> biases(i, j);
+            }
         }
-    }
-    file >> rows >> cols;
-    weights2.resize(rows, cols);
-    for (int i = 0; i < rows; ++i) {
-        for (int j = 0; j < cols; ++j) {
-            file >> weights2(i, j);
+        if (!file) {
+            throw std::runtime_error("Truncated model file");
         }
-    }
-    file >> rows >> cols;
-    biases2.resize(rows, cols);
-    for (int i = 0; i < rows; ++i) {
-        for (int j = 0; j < cols; ++j) {
-            file >> biases2(i, j);
+        if (!loaded.empty() && loaded.back().outputSize() != weights.columns()) {
+            throw std::runtime_error("Layer sizes in model file do not chain");
         }
+        // Keep the activation this network already uses at the same depth
+        size_t depth = loaded.size();
+        Activation activation = depth < layers.size() ? layers[depth].activation() : Activation::Sigmoid;
+        loaded.emplace_back(weights, biases, activation);
+    }
+    if (loaded.empty()) {
+        throw std::runtime_error("Model file contains no layers");
     }
 
     file.close();
+    layers = std::move(loaded);
+    updateLayerSizes();
+    applyOutputActivation();
+    resetOptimizer();
+    resetTrainingState();
+    setPrecision(precision);
+    resetAverage();
+    publishSnapshot();
 }
@@ -2,10 +2,64 @@
 #define NEURALNETWORK_H
 
 #include "Matrix.h"
+#include "Layer.h"
+#include "Optimizer.h"
+#include "InferenceEngine.h"
+#include "RcuPointer.h"
+#include "RingBuffer.h"
+#include "Checkpoint.h"
+#include <atomic>
+#include <memory>
+#include <random>
 #include <vector>
 #include <string>
 #include <QThread>
 
+// Loss minimized by train(). SquaredError trains a sigmoid output layer against
+// a one-hot target; SoftmaxCrossEntropy turns the output layer linear and
+// applies a softmax on top of it.
+enum class LossFunction {
+    SquaredError,
+    SoftmaxCrossEntropy
+};
+
+// Throughput and wall-clock breakdown of one training epoch. The phase times are
+// measured with omp_get_wtime(): forward and backward split the per-sample pass
+// (backward also covers the weight gradients), update covers the optimizer step
+// and gather is the time spent waiting for the background BatchLoader.
+struct EpochStats {
+    int epoch = 0;
+    long long samples = 0;
+    double seconds = 0.0;
+    double samplesPerSecond = 0.0;
+    double gflops = 0.0;
+    double shuffleSeconds = 0.0;
+    double gatherSeconds = 0.0;
+    double forwardSeconds = 0.0;
+    double backwardSeconds = 0.0;
+    double updateSeconds = 0.0;
+    double validationSeconds = 0.0;
+};
+Q_DECLARE_METATYPE(EpochStats)
+
+// Telemetry of one optimizer step, recorded by applyGradients() and read with pollMetrics()
+struct BatchMetrics {
+    long long step = 0;
+    int epoch = 0;
+    int samples = 0;
+    double loss = 0.0;         // mean loss of the batch, measured before the update
+    double accuracy = 0.0;     // fraction of the batch classified correctly before the update
+    double gradientNorm = 0.0; // L2 norm of the mean gradient over all weights and biases
+};
+
+// Settings of NeuralNetwork::learnOnline()
+struct OnlineLearningConfig {
+    double learningRateScale = 0.1; // multiplies the optimizer's learning rate for online updates
+    double maxGradientNorm = 1.0;   // gradient norms above this are scaled down to it (0 = no clipping)
+    int batchSize = 8;              // new samples per update
+    double replayRatio = 1.0;       // old samples replayed per new sample (0 = no replay)
+    int replayCapacity = 10000;     // samples kept for replay
+};
 
 class NeuralNetwork : public QObject {
     Q_OBJECT
@@ -20,13 +74,74 @@ public:
     int getHiddenSize() const;
     int getOutputSize() const;
     double getLearningRate() const;
+    int getLayerCount() const;
+    const DenseLayer& getLayer(int index) const;
+    std::vector<int> getLayerSizes() const;
+    int getNumThreads() const;
+    void setNumThreads(int threads);
+    const OptimizerConfig& getOptimizerConfig() const;
+    void setOptimizer(const OptimizerConfig& config);
+    void setLayerActivation(int index, Activation activation);
+    Precision getPrecision() const;
+    void setPrecision(Precision newPrecision);
+    LossFunction getLossFunction() const;
+    void setLossFunction(LossFunction loss);
+    void setValidationSplit(double fraction);
+    void setEarlyStopping(int patience, double minDelta = 0.0);
+    void setTrainingBudget(double maxSeconds, long long maxSamples = 0);
+    void setPrioritizedSampling(double fraction, double exponent = 1.0, double uniformMix = 0.1);
+    void setOnlineLearning(const OnlineLearningConfig& config);
+    const OnlineLearningConfig& getOnlineLearning() const;
+    void addToReplayBuffer(const std::vector<std::vector<double>>& inputs, const std::vector<int>& labels);
+    int replayBufferSize() const;
+    void setSnapshotInterval(int batches);
+    void publishSnapshot();
+    RcuPointer<InferenceEngine>::ReadGuard snapshot() const;
+    void setCheckpointing(const std::string& path, int everyBatches = 0);
+    void saveCheckpoint();
+    void flushCheckpoints();
+    void resumeFromCheckpoint(const std::string& path);
+    bool hasActiveTraining() const;
+    void resetTrainingState();
+    void requestStop();
+    void setPaused(bool paused);
+    bool isPaused() const;
+    const EpochStats& getLastEpochStats() const;
+    std::size_t pollMetrics(std::vector<BatchMetrics>& out, std::size_t maxCount = static_cast<std::size_t>(-1));
+    long long droppedMetrics() const;
+    void setDeterministic(bool enabled, unsigned seed = 0);
+    bool isDeterministic() const;
+    void setModelParallel(bool enabled);
+    void setWeightAveraging(double decay, bool useForEvaluation = true);
+    double getWeightAveragingDecay() const;
+    const std::vector<DenseLayer>& getEvaluationLayers() const;
+    bool isModelParallel() const;
+    double flopsPerSample() const;
 
     NeuralNetwork(int inputSize, int hiddenSize, int outputSize, double learningRate);
+    NeuralNetwork(const std::vector<int>& layerSizes, double learningRate,
+                  Activation hiddenActivation = Activation::Sigmoid);
     std::vector<double> predict(std::vector<double>& input);
     int oneHotPredict(std::vector<double>& input);
     void train(std::vector<std::vector<double>>& inputs, std::vector<int>& labels, int epochs, std::vector<double>& errors, int batchSize);
+    double evaluate(const std::vector<std::vector<double>>& inputs, const std::vector<int>& labels);
+    double evaluate(const std::vector<std::vector<double>>& inputs, const std::vector<int>& labels,
+                    const std::vector<int>& indices);
+    double trainBatch(const double* const* batchInputs, const int* batchLabels, int count);
+    double computeGradients(const double* const* batchInputs, const int* batchLabels, int count);
+    void applyGradients(double squaredNorm = -1.0);
+    MyMatrix& getWeightGradient(int index);
+    MyMatrix& getBiasGradient(int index);
+    void copyParametersFrom(const NeuralNetwork& other);
+    std::size_t parameterCount() const;
+    void getParameters(double* out) const;
+    void setParameters(const double* values);
+    double learnOnline(const std::vector<std::vector<double>>& inputs, const std::vector<int>& labels);
+    double fineTuneHead(const std::vector<std::vector<double>>& inputs, const std::vector<int>& labels, int epochs,
+                        int batchSize, int newOutputSize = 0);
 
     static double calcSigmoid(double n);
+    static double softmax(double* values, int count);
     void sigmoid(MyMatrix& matrix);
     void save(const std::string& filename) const;
     void load(const std::string& filename);
@@ -35,16 +150,108 @@ signals:
     void trainingProgress(QString message);
     void epochUpdates(int epoch);
     void errorReported(double error);
+    void validationReported(double accuracy);
+    void epochStatsReported(const EpochStats& stats);
 
 private:
     int inputSize;
     int hiddenSize;
     int outputSize;
-    double learningRate;
-    MyMatrix weights1;
-    MyMatrix biases1;
-    MyMatrix weights2;
-    MyMatrix biases2;
+    int numThreads;
+    std::vector<DenseLayer> layers;
+    Optimizer optimizer;
+    LossFunction lossFunction;
+    Precision precision;
+    double validationSplit;
+    int earlyStoppingPatience;
+    double earlyStoppingMinDelta;
+    double maxTrainingSeconds;
+    long long maxTrainingSamples;
+    int snapshotInterval;
+    RcuPointer<InferenceEngine> snapshotPointer;
+
+    // Progress of the current (or interrupted) train() run and where it is checkpointed
+    TrainingState trainingState;
+    std::string checkpointPath;
+    int checkpointInterval;
+    std::unique_ptr<CheckpointWriter> checkpointWriter;
+
+    // Command for a running train() call, set from any thread and polled at batch boundaries.
+    // IdleCommand means no train() call is running, so pause and stop requests are ignored.
+    enum TrainingCommand { IdleCommand, RunCommand, PauseCommand, StopCommand };
+    std::atomic<int> trainingCommand;
+
+    // Deterministic mode: weights and shuffles are derived from the seed instead of std::random_device
+    bool deterministic;
+    unsigned seed;
+
+    // Loss-prioritized sampling (0 = every epoch is a full shuffled pass)
+    double sampleFraction;
+    double priorityExponent;
+    double priorityUniformMix;
+
+    // Online learning: bounded updates on new samples, mixed with a reservoir of earlier ones
+    OnlineLearningConfig onlineConfig;
+    double gradientClipNorm;
+    std::vector<std::vector<double>> replayInputs;
+    std::vector<int> replayLabels;
+    long long replaySeen;
+    std::mt19937 onlineRng;
+
+    // Exponential moving average of the parameters (decay 0 = off), kept in double precision
+    double averageDecay;
+    bool evaluateAverage;
+    std::vector<DenseLayer> averageLayers;
+
+    // Model-parallel mode: every thread owns a slice of the hidden units
+    bool modelParallel;
+    std::vector<double> partialOutputs;
+    std::vector<double> sliceSquaredNorms;
+
+    // Per-slot loss of the current batch, summed in slot order so the total does not depend on threads
+    std::vector<double> sampleLosses;
+    std::vector<char> sampleCorrect;
+    std::vector<std::vector<double>> gradientRowNorms;
+
+    // Per-batch telemetry; applyGradients() is the only producer, pollMetrics() the only consumer.
+    // computeGradients() fills in the record of the step in progress.
+    RingBuffer<BatchMetrics> metrics;
+    BatchMetrics pendingMetrics;
+
+    // Timings of the epoch in progress (filled by train() and trainBatch()) and of the last finished one
+    EpochStats currentStats;
+    EpochStats lastEpochStats;
+
+    // Training buffers, one row per sample slot of a batch and one matrix per layer.
+    // They are sized by reserveBatch() and reused for every batch and epoch.
+    int workspaceBatchSize;
+    std::vector<MyMatrix> activations;
+    std::vector<MyMatrix> deltas;
+    std::vector<std::vector<const double*>> layerInputs;
+    std::vector<MyMatrix> weightGradients;
+    std::vector<MyMatrix> biasGradients;
+
+    // Non-zero entries of every sample's input, inputSize slots per sample, for the first layer's gradient
+    std::vector<int> inputNonZeroIndices;
+    std::vector<double> inputNonZeroValues;
+    std::vector<int> inputNonZeroCounts;
+
+    void reserveBatch(int batchSize);
+    void updateLayerSizes();
+    NeuralNetwork(std::vector<DenseLayer> layerStack, double learningRate);
+    static std::vector<DenseLayer> buildLayers(const std::vector<int>& layerSizes, Activation hiddenActivation);
+    void resetOptimizer();
+    static std::vector<int> optimizerTensorSizes(const std::vector<DenseLayer>& layerStack);
+    void applyOutputActivation();
+    bool stopRequested();
+    void initializeWeights(std::mt19937& generator);
+    void samplePrioritizedOrder();
+    double computeOutputError(double* output, double* outputError, int label) const;
+    void collectNonZeroInputs(const double* input, int slot);
+    SparseRows sparseBatchInputs() const;
+    void growOutputLayer(int newOutputSize);
+    void resetAverage();
+    double trainBatchModelParallel(const double* const* batchInputs, const int* batchLabels, int count);
 };
 
 #endif
@@ -0,0 +1,303 @@
+#include "NumaTrainer.h"
+#include <algorithm>
+#include <cctype>
+#include <condition_variable>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <numeric>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <sched.h>
+
+namespace {
+
+// Reusable barrier for the node threads (std::barrier needs C++20)
+class Barrier {
+public:
+    explicit Barrier(int count) : m_count(count), m_waiting(0), m_generation(0) {}
+
+    void wait() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        const unsigned generation = m_generation;
+        if (++m_waiting == m_count) {
+            m_waiting = 0;
+            ++m_generation;
+            m_released.notify_all();
+            return;
+        }
+        m_released.wait(lock, [&] { return generation != m_generation; });
+    }
+
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_released;
+    const int m_count;
+    int m_waiting;
+    unsigned m_generation;
+};
+
+// Function to parse a sysfs CPU list such as "0-15,32-47"
+std::vector<int> parseCpuList(const std::string& list) {
+    std::vector<int> cpus;
+    std::stringstream stream(list);
+    std::string range;
+    while (std::getline(stream, range, ',')) {
+        if (range.empty() || range == "\n") {
+            continue;
+        }
+        size_t dash = range.find('-');
+        int first = std::stoi(range.substr(0, dash));
+        int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+        for (int cpu = first; cpu <= last; ++cpu) {
+            cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
+
+// Function to restrict the calling thread (and the OpenMP team it starts later) to a set of CPUs.
+// Pinning is best effort: without permission the thread simply keeps running unpinned.
+void pinCurrentThread(const std::vector<int>& cpus) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) {
+        if (cpu >= 0 && cpu < CPU_SETSIZE) {
+            CPU_SET(cpu, &set);
+        }
+    }
+    sched_setaffinity(0, sizeof(set), &set);
+}
+
+} // namespace
+
+// Constructor taking the network to train; the topology is detected right away
+NumaTrainer::NumaTrainer(NeuralNetwork& network) : m_network(network), m_nodes(detectNodes()) {}
+
+// Function to read the CPUs of every NUMA node this process may run on. Nodes without
+// allowed CPUs (e.g. memory-only nodes or ones excluded by a cpuset) are left out.
+std::vector<std::vector<int>> NumaTrainer::detectNodes() {
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        for (int cpu = 0; cpu < static_cast<int>(std::thread::hardware_concurrency()); ++cpu) {
+            CPU_SET(cpu, &allowed);
+        }
+    }
+
+    std::vector<std::pair<int, std::vector<int>>> found;
+    std::error_code error;
+    for (const auto& entry : std::filesystem::directory_iterator("/sys/devices/system/node", error)) {
+        std::string name = entry.path().filename().string();
+        if (name.compare(0, 4, "node") != 0 || name.size() == 4 ||
+            !std::all_of(name.begin() + 4, name.end(), ::isdigit)) {
+            continue;
+        }
+        std::ifstream file(entry.path() / "cpulist");
+        std::string list;
+        std::getline(file, list);
+        std::vector<int> cpus;
+        for (int cpu : parseCpuList(list)) {
+            if (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed)) {
+                cpus.push_back(cpu);
+            }
+        }
+        if (!cpus.empty()) {
+            found.emplace_back(std::stoi(name.substr(4)), cpus);
+        }
+    }
+    std::sort(found.begin(), found.end());
+
+    std::vector<std::vector<int>> nodes;
+    for (auto& node : found) {
+        nodes.push_back(std::move(node.second));
+    }
+
+    // Unknown topology: one node with every allowed CPU
+    if (nodes.empty()) {
+        nodes.emplace_back();
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET(cpu, &allowed)) {
+                nodes.back().push_back(cpu);
+            }
+        }
+    }
+    return nodes;
+}
+
+// Function to override the detected topology, e.g. to use only some sockets.
+// Every entry lists the CPUs of one replica.
+void NumaTrainer::setNodes(const std::vector<std::vector<int>>& nodes) {
+    if (nodes.empty() || std::any_of(nodes.begin(), nodes.end(), [](const std::vector<int>& cpus) { return cpus.empty(); })) {
+        throw std::invalid_argument("Every NUMA node needs at least one CPU");
+    }
+    m_nodes = nodes;
+}
+
+int NumaTrainer::nodeCount() const {
+    return static_cast<int>(m_nodes.size());
+}
+
+/**
+ * @brief Trains the network data-parallel with one replica per NUMA node.
+ *
+ * The samples are dealt to the nodes at random once. A mini-batch of batchSize
+ * samples is made of batchSize / nodeCount() samples from every shard, and the
+ * epoch ends when the largest shard has been visited once. When training ends,
+ * the network takes over the parameters and optimizer state of the replicas.
+ *
+ * @param inputs A vector of input vectors, each representing the features of a training example.
+ * @param labels The target label of every input vector.
+ * @param epochs The number of passes over the training data.
+ * @param batchSize The number of training examples in each mini-batch, summed over all nodes.
+ * @return The mean training loss of the last epoch.
+ * @throws std::invalid_argument If there are fewer samples than nodes or the batch size is not positive.
+ */
+double NumaTrainer::train(const std::vector<std::vector<double>>& inputs, const std::vector<int>& labels, int epochs,
+                          int batchSize) {
+    const int numNodes = nodeCount();
+    const int numSamples = static_cast<int>(inputs.size());
+    if (numSamples < numNodes || batchSize < 1) {
+        throw std::invalid_argument("NumaTrainer needs a positive batch size and at least one sample per node");
+    }
+    std::random_device rd;
+    std::mt19937 g(rd());
+
+    // Deal the shuffled samples to the nodes; shard sizes differ by at most one
+    std::vector<int> order(numSamples);
+    std::iota(order.begin(), order.end(), 0);
+    std::shuffle(order.begin(), order.end(), g);
+    const int localBatch = std::max(1, (batchSize + numNodes - 1) / numNodes);
+    const int largestShard = (numSamples + numNodes - 1) / numNodes;
+    const int steps = (largestShard + localBatch - 1) / localBatch;
+    const std::vector<int> layerSizes = m_network.getLayerSizes();
+
+    std::vector<Replica> replicas(numNodes);
+    for (Replica& replica : replicas) {
+        replica.rng.seed(g());
+    }
+    Barrier barrier(numNodes);
+
+    auto work = [&](int node) {
+        const int threads = static_cast<int>(m_nodes[node].size());
+        pinCurrentThread(m_nodes[node]);
+
+        // First touch: the shard and the replica are allocated by the pinned thread
+        Replica& replica = replicas[node];
+        for (int i = node; i < numSamples; i += numNodes) {
+            replica.inputs.push_back(inputs[order[i]]);
+            replica.labels.push_back(labels[order[i]]);
+        }
+        replica.network.reset(new NeuralNetwork(layerSizes, m_network.getOptimizerConfig().learningRate));
+        replica.network->copyParametersFrom(m_network);
+        replica.network->setNumThreads(threads);
+        replica.order.resize(replica.inputs.size());
+        std::iota(replica.order.begin(), replica.order.end(), 0);
+        replica.epochErrors.assign(epochs, 0.0);
+        const int shardSize = static_cast<int>(replica.order.size());
+        std::vector<const double*> batchInputs(localBatch);
+        std::vector<int> batchLabels(localBatch);
+
+        for (int epoch = 0; epoch < epochs; ++epoch) {
+            std::shuffle(replica.order.begin(), replica.order.end(), replica.rng);
+            for (int step = 0; step < steps; ++step) {
+                int start = step * localBatch;
+                int end = std::min(start + localBatch, shardSize);
+                replica.count = std::max(0, end - start);
+                for (int i = start; i < end; ++i) {
+                    batchInputs[i - start] = replica.inputs[replica.order[i]].data();
+                    batchLabels[i - start] = replica.labels[replica.order[i]];
+                }
+                if (replica.count > 0) {
+                    replica.epochErrors[epoch] += replica.network->computeGradients(batchInputs.data(), batchLabels.data(),
+                                                                                    replica.count);
+                }
+
+                // Average the gradients; each node reduces its slice into every replica
+                barrier.wait();
+                reduceSlice(replicas, node, threads);
+                barrier.wait();
+
+                double squaredNorm = 0.0;
+                for (const Replica& other : replicas) {
+                    squaredNorm += other.squaredNorm;
+                }
+                replica.network->applyGradients(squaredNorm);
+            }
+
+            // The first node reports once every node has finished the epoch
+            barrier.wait();
+            if (node == 0) {
+                double error = 0.0;
+                for (const Replica& other : replicas) {
+                    error += other.epochErrors[epoch];
+                }
+                error /= numSamples;
+                emit epochCompleted(epoch, error);
+                emit trainingProgress(QString("Epoch %1 completed on %2 NUMA nodes. Error: %3").arg(epoch).arg(numNodes).arg(error));
+            }
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (int node = 0; node < numNodes; ++node) {
+        pool.emplace_back(work, node);
+    }
+    for (std::thread& thread : pool) {
+        thread.join();
+    }
+
+    // All replicas hold the same parameters; hand them back to the network
+    m_network.copyParametersFrom(*replicas.front().network);
+    double error = 0.0;
+    for (const Replica& replica : replicas) {
+        error += epochs > 0 ? replica.epochErrors.back() : 0.0;
+    }
+    return error / numSamples;
+}
+
+// Function to replace one node's slice of every gradient tensor, in every replica, by the
+// sample-weighted mean over the replicas, and to record the squared norm of that slice
+void NumaTrainer::reduceSlice(std::vector<Replica>& replicas, int node, int threads) {
+    const int numNodes = static_cast<int>(replicas.size());
+    int total = 0;
+    for (const Replica& replica : replicas) {
+        total += replica.count;
+    }
+    std::vector<double> weights(numNodes);
+    for (int k = 0; k < numNodes; ++k) {
+        weights[k] = static_cast<double>(replicas[k].count) / total;
+    }
+
+    double squaredNorm = 0.0;
+    std::vector<double*> grads(numNodes);
+    const int numLayers = replicas.front().network->getLayerCount();
+    for (int tensor = 0; tensor < 2 * numLayers; ++tensor) {
+        for (int k = 0; k < numNodes; ++k) {
+            NeuralNetwork& network = *replicas[k].network;
+            grads[k] = tensor % 2 == 0 ? network.getWeightGradient(tensor / 2).data()
+                                       : network.getBiasGradient(tensor / 2).data();
+        }
+        const MyMatrix& shape = tensor % 2 == 0 ? replicas[node].network->getWeightGradient(tensor / 2)
+                                                : replicas[node].network->getBiasGradient(tensor / 2);
+        const long long size = static_cast<long long>(shape.rows()) * shape.columns();
+        const long long begin = size * node / numNodes;
+        const long long end = size * (node + 1) / numNodes;
+
+#pragma omp parallel for num_threads(threads) reduction(+:squaredNorm) schedule(static) if (end - begin > 4096)
+        for (long long i = begin; i < end; ++i) {
+            double sum = 0.0;
+            for (int k = 0; k < numNodes; ++k) {
+                if (weights[k] > 0.0) {
+                    sum += weights[k] * grads[k][i];
+                }
+            }
+            for (int k = 0; k < numNodes; ++k) {
+                grads[k][i] = sum;
+            }
+            squaredNorm += sum * sum;
+        }
+    }
+    replicas[node].squaredNorm = squaredNorm;
+}
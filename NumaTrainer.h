@@ -0,0 +1,62 @@
+#ifndef NUMATRAINER_H
+#define NUMATRAINER_H
+
+#include "Neuronal_Network.h"
+#include <QObject>
+#include <memory>
+#include <random>
+#include <vector>
+
+// Data-parallel training across the NUMA nodes (sockets) of one machine. Every
+// node gets a worker thread pinned to its CPUs, which allocates a shard of the
+// training data and a replica of the network itself, so the kernel's first-touch
+// policy places both in the node's local memory. The OpenMP team each worker
+// starts inherits its affinity and only ever reads node-local rows and weights.
+//
+// Each step, every replica computes the mean gradient of its part of the
+// mini-batch; the gradients are then averaged (each node reduces one slice of
+// every tensor) and every replica applies the same optimizer step, so the
+// replicas stay identical. Only this reduction crosses the interconnect.
+//
+// The topology is read from /sys/devices/system/node; without it, or on a
+// single-node machine, one replica with all allowed CPUs is used. Like
+// MultiModelTrainer, the train()-level options of the network (validation
+// split, early stopping, budgets, checkpoints) are not used. OMP_PROC_BIND
+// must not be set, or the OpenMP runtime overrides the pinning.
+class NumaTrainer : public QObject {
+    Q_OBJECT
+
+public:
+    explicit NumaTrainer(NeuralNetwork& network);
+
+    static std::vector<std::vector<int>> detectNodes();
+    void setNodes(const std::vector<std::vector<int>>& nodes);
+    int nodeCount() const;
+
+    double train(const std::vector<std::vector<double>>& inputs, const std::vector<int>& labels, int epochs,
+                 int batchSize);
+
+signals:
+    void trainingProgress(QString message);
+    void epochCompleted(int epoch, double error);
+
+private:
+    // Everything a node works on; allocated by the node's own pinned thread
+    struct Replica {
+        std::unique_ptr<NeuralNetwork> network;
+        std::vector<std::vector<double>> inputs;
+        std::vector<int> labels;
+        std::vector<int> order;
+        std::mt19937 rng;
+        std::vector<double> epochErrors;
+        int count = 0;
+        double squaredNorm = 0.0;
+    };
+
+    NeuralNetwork& m_network;
+    std::vector<std::vector<int>> m_nodes;
+
+    void reduceSlice(std::vector<Replica>& replicas, int node, int threads);
+};
+
+#endif // NUMATRAINER_H
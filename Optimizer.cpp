@@ -0,0 +1,206 @@
+#include "Optimizer.h"
+#include "BinaryIO.h"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+// Default constructor for plain SGD with the default learning rate
+Optimizer::Optimizer() : m_step(0), m_stepSize(0.0) {}
+
+// Constructor to create an optimizer with the given hyperparameters
+Optimizer::Optimizer(const OptimizerConfig& config)
+    : m_config(config), m_step(0), m_stepSize(0.0) {}
+
+const OptimizerConfig& Optimizer::config() const {
+    return m_config;
+}
+
+// Function to change the learning rate from the next step on; the optimizer state is kept
+void Optimizer::setLearningRate(double learningRate) {
+    m_config.learningRate = learningRate;
+}
+
+// Function to get the number of steps taken since the last reset
+long long Optimizer::stepCount() const {
+    return m_step;
+}
+
+// Function to (re)allocate the optimizer state for the given parameter tensors
+void Optimizer::reset(const std::vector<int>& tensorSizes) {
+    m_step = 0;
+    m_first.assign(tensorSizes.size(), std::vector<double>());
+    m_second.assign(tensorSizes.size(), std::vector<double>());
+    for (size_t t = 0; t < tensorSizes.size(); ++t) {
+        if (m_config.type != OptimizerType::SGD) {
+            m_first[t].assign(tensorSizes[t], 0.0);
+        }
+        if (m_config.type == OptimizerType::Adam) {
+            m_second[t].assign(tensorSizes[t], 0.0);
+        }
+    }
+}
+
+// Function to advance the step counter; must be called once before the step() calls of a batch
+void Optimizer::beginStep() {
+    ++m_step;
+    m_stepSize = m_config.learningRate;
+    if (m_config.type == OptimizerType::Adam) {
+        // Fold the bias corrections of both moments into the step size
+        double correction1 = 1.0 - std::pow(m_config.beta1, static_cast<double>(m_step));
+        double correction2 = 1.0 - std::pow(m_config.beta2, static_cast<double>(m_step));
+        m_stepSize = m_config.learningRate * std::sqrt(correction2) / correction1;
+    }
+}
+
+/**
+ * @brief Updates one parameter tensor from its gradient.
+ *
+ * Each element is read and written exactly once: the optimizer state and the
+ * parameter are updated in the same loop so the tensor is streamed through the
+ * cache a single time. The chunks of the tensor are an orphaned OpenMP
+ * worksharing loop, so calling it from inside a parallel region splits the
+ * tensor across the team; called outside one it simply runs serially.
+ *
+ * @param tensor The index of the tensor as registered in reset().
+ * @param params The parameter values, updated in place.
+ * @param grads The gradient of the loss with respect to params.
+ * @param count The number of elements in the tensor.
+ * @param gradientScale A factor applied to every gradient element, e.g. for norm clipping.
+ * @param average Optional exponential moving average of params, updated right after each chunk
+ *                of params while that chunk is still in the L1 cache.
+ * @param averageDecay The weight of the old average: average = decay * average + (1 - decay) * params.
+ */
+void Optimizer::step(int tensor, double* params, const double* grads, int count, double gradientScale,
+                     double* average, double averageDecay) {
+    const int chunk = 4096;
+    const int numChunks = (count + chunk - 1) / chunk;
+#pragma omp for schedule(static)
+    for (int c = 0; c < numChunks; ++c) {
+        stepRange(tensor, params, grads, c * chunk, std::min(count, (c + 1) * chunk), gradientScale, average, averageDecay);
+    }
+}
+
+// Function to update only the elements begin..end-1 of a tensor, on the calling thread.
+// params and grads point to the start of the whole tensor, as for step(); threads that own
+// disjoint ranges of a tensor can update them concurrently after one beginStep().
+void Optimizer::stepRange(int tensor, double* params, const double* grads, int begin, int end, double gradientScale,
+                          double* average, double averageDecay) {
+    const double lr = m_stepSize;
+    const double scale = gradientScale;
+    switch (m_config.type) {
+    case OptimizerType::SGD: {
+#pragma omp simd
+        for (int i = begin; i < end; ++i) {
+            params[i] -= lr * scale * grads[i];
+        }
+        break;
+    }
+    case OptimizerType::Momentum: {
+        double* velocity = m_first[tensor].data();
+        const double mu = m_config.momentum;
+#pragma omp simd
+        for (int i = begin; i < end; ++i) {
+            double v = mu * velocity[i] + scale * grads[i];
+            velocity[i] = v;
+            params[i] -= lr * v;
+        }
+        break;
+    }
+    case OptimizerType::Nesterov: {
+        double* velocity = m_first[tensor].data();
+        const double mu = m_config.momentum;
+#pragma omp simd
+        for (int i = begin; i < end; ++i) {
+            double g = scale * grads[i];
+            double v = mu * velocity[i] + g;
+            velocity[i] = v;
+            params[i] -= lr * (g + mu * v);
+        }
+        break;
+    }
+    case OptimizerType::Adam: {
+        double* m = m_first[tensor].data();
+        double* v = m_second[tensor].data();
+        const double beta1 = m_config.beta1;
+        const double beta2 = m_config.beta2;
+        const double eps = m_config.epsilon;
+#pragma omp simd
+        for (int i = begin; i < end; ++i) {
+            double g = scale * grads[i];
+            double mi = beta1 * m[i] + (1.0 - beta1) * g;
+            double vi = beta2 * v[i] + (1.0 - beta2) * g * g;
+            m[i] = mi;
+            v[i] = vi;
+            params[i] -= lr * mi / (std::sqrt(vi) + eps);
+        }
+        break;
+    }
+    }
+
+    // Fold the new values into the moving average while they are still in cache
+    if (average) {
+        const double keep = averageDecay;
+        const double take = 1.0 - averageDecay;
+#pragma omp simd
+        for (int i = begin; i < end; ++i) {
+            average[i] = keep * average[i] + take * params[i];
+        }
+    }
+}
+
+// Function to write the configuration, step counter and per-element state in binary form
+void Optimizer::saveState(std::ostream& stream) const {
+    writeValue<int>(stream, static_cast<int>(m_config.type));
+    writeValue<double>(stream, m_config.learningRate);
+    writeValue<double>(stream, m_config.momentum);
+    writeValue<double>(stream, m_config.beta1);
+    writeValue<double>(stream, m_config.beta2);
+    writeValue<double>(stream, m_config.epsilon);
+    writeValue<long long>(stream, m_step);
+    writeValue<int>(stream, static_cast<int>(m_first.size()));
+    for (size_t t = 0; t < m_first.size(); ++t) {
+        writeVector(stream, m_first[t]);
+        writeVector(stream, m_second[t]);
+    }
+}
+
+// Function to restore an optimizer written by saveState
+void Optimizer::loadState(std::istream& stream) {
+    int type = readValue<int>(stream);
+    if (type < 0 || type > static_cast<int>(OptimizerType::Adam)) {
+        throw std::runtime_error("Corrupt optimizer state");
+    }
+    m_config.type = static_cast<OptimizerType>(type);
+    m_config.learningRate = readValue<double>(stream);
+    m_config.momentum = readValue<double>(stream);
+    m_config.beta1 = readValue<double>(stream);
+    m_config.beta2 = readValue<double>(stream);
+    m_config.epsilon = readValue<double>(stream);
+    m_step = readValue<long long>(stream);
+    int tensors = readValue<int>(stream);
+    if (tensors < 0) {
+        throw std::runtime_error("Corrupt optimizer state");
+    }
+    m_first.assign(tensors, std::vector<double>());
+    m_second.assign(tensors, std::vector<double>());
+    for (int t = 0; t < tensors; ++t) {
+        m_first[t] = readVector<double>(stream);
+        m_second[t] = readVector<double>(stream);
+    }
+}
+
+// Function to check whether the optimizer's state belongs to tensors of the given sizes
+// (e.g. after loadState(), before stepping parameters with it)
+bool Optimizer::matchesTensors(const std::vector<int>& tensorSizes) const {
+    if (m_first.size() != tensorSizes.size() || m_second.size() != tensorSizes.size()) {
+        return false;
+    }
+    for (size_t t = 0; t < tensorSizes.size(); ++t) {
+        size_t firstSize = m_config.type != OptimizerType::SGD ? tensorSizes[t] : 0;
+        size_t secondSize = m_config.type == OptimizerType::Adam ? tensorSizes[t] : 0;
+        if (m_first[t].size() != firstSize || m_second[t].size() != secondSize) {
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,57 @@
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+#include <iosfwd>
+#include <vector>
+
+enum class OptimizerType {
+    SGD,
+    Momentum,
+    Nesterov,
+    Adam
+};
+
+// Hyperparameters of an optimizer. Fields that do not apply to the selected
+// type are ignored (e.g. beta1/beta2 for SGD).
+struct OptimizerConfig {
+    OptimizerType type = OptimizerType::SGD;
+    double learningRate = 0.1;
+    double momentum = 0.9;
+    double beta1 = 0.9;
+    double beta2 = 0.999;
+    double epsilon = 1e-8;
+};
+
+// Applies gradient steps to a fixed set of parameter tensors. Every tensor is
+// registered once with its element count; the optimizer keeps the per-element
+// state (velocity, first/second moments) for it. step() reads the gradient,
+// updates the state and writes the new parameter value in a single pass.
+class Optimizer {
+private:
+    OptimizerConfig m_config;
+    long long m_step;
+    std::vector<std::vector<double>> m_first;
+    std::vector<std::vector<double>> m_second;
+    double m_stepSize;
+
+public:
+    Optimizer();
+    explicit Optimizer(const OptimizerConfig& config);
+
+    const OptimizerConfig& config() const;
+    void setLearningRate(double learningRate);
+    long long stepCount() const;
+
+    void reset(const std::vector<int>& tensorSizes);
+    void beginStep();
+    void step(int tensor, double* params, const double* grads, int count, double gradientScale = 1.0,
+              double* average = nullptr, double averageDecay = 0.0);
+    void stepRange(int tensor, double* params, const double* grads, int begin, int end, double gradientScale = 1.0,
+                   double* average = nullptr, double averageDecay = 0.0);
+
+    void saveState(std::ostream& stream) const;
+    void loadState(std::istream& stream);
+    bool matchesTensors(const std::vector<int>& tensorSizes) const;
+};
+
+#endif // OPTIMIZER_H
@@ -0,0 +1,112 @@
+#ifndef RCUPOINTER_H
+#define RCUPOINTER_H
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+/**
+ * @brief A pointer to an immutable object that one writer replaces while any
+ * number of readers keep using older versions (read-copy-update).
+ *
+ * Readers never lock: read() registers the reader in the current epoch with one
+ * atomic increment, loads the pointer and returns a guard that unregisters on
+ * destruction. The writer never waits either: publish() swaps the pointer in and
+ * retires the old object to the list of the current epoch. A retired object is
+ * deleted once every reader registered in its epoch (or before) has finished,
+ * which publish() checks without blocking; until then it simply stays retired.
+ *
+ * Epochs alternate between two reader counters. The writer advances the epoch
+ * only when the counter of the previous epoch has drained, so at most the
+ * current and the previous epoch can have readers at any time.
+ *
+ * publish() must only be called from one thread at a time.
+ */
+template <typename T>
+class RcuPointer {
+public:
+    class ReadGuard {
+    public:
+        ReadGuard() : m_value(nullptr), m_counter(nullptr) {}
+        ReadGuard(const T* value, std::atomic<long>* counter) : m_value(value), m_counter(counter) {}
+        ReadGuard(ReadGuard&& other) noexcept : m_value(other.m_value), m_counter(other.m_counter) {
+            other.m_value = nullptr;
+            other.m_counter = nullptr;
+        }
+        ReadGuard(const ReadGuard&) = delete;
+        ReadGuard& operator=(const ReadGuard&) = delete;
+        ~ReadGuard() {
+            if (m_counter) {
+                m_counter->fetch_sub(1);
+            }
+        }
+
+        const T* get() const { return m_value; }
+        const T* operator->() const { return m_value; }
+        const T& operator*() const { return *m_value; }
+        explicit operator bool() const { return m_value != nullptr; }
+
+    private:
+        const T* m_value;
+        std::atomic<long>* m_counter;
+    };
+
+    RcuPointer() : m_current(nullptr), m_epoch(0) {
+        m_readers[0] = 0;
+        m_readers[1] = 0;
+    }
+
+    RcuPointer(const RcuPointer&) = delete;
+    RcuPointer& operator=(const RcuPointer&) = delete;
+
+    // All readers must have released their guards before the pointer is destroyed
+    ~RcuPointer() {
+        delete m_current.load();
+        for (std::vector<T*>& retired : m_retired) {
+            for (T* value : retired) {
+                delete value;
+            }
+        }
+    }
+
+    // Function to get the latest published object; lock-free and wait-free unless an epoch flips concurrently
+    ReadGuard read() const {
+        for (;;) {
+            unsigned epoch = m_epoch.load();
+            std::atomic<long>* counter = &m_readers[epoch & 1];
+            counter->fetch_add(1);
+            if (m_epoch.load() == epoch) {
+                return ReadGuard(m_current.load(), counter);
+            }
+            // The writer advanced the epoch in between; register again in the new one
+            counter->fetch_sub(1);
+        }
+    }
+
+    // Function to replace the current object; the previous one is reclaimed once no reader can hold it
+    void publish(std::unique_ptr<T> value) {
+        T* previous = m_current.exchange(value.release());
+        unsigned epoch = m_epoch.load();
+        if (previous) {
+            m_retired[epoch & 1].push_back(previous);
+        }
+
+        // Readers of the previous epoch are gone: free what was retired then and start a new epoch
+        unsigned other = (epoch + 1) & 1;
+        if (m_readers[other].load() == 0) {
+            for (T* value : m_retired[other]) {
+                delete value;
+            }
+            m_retired[other].clear();
+            m_epoch.store(epoch + 1);
+        }
+    }
+
+private:
+    std::atomic<T*> m_current;
+    std::atomic<unsigned> m_epoch;
+    mutable std::atomic<long> m_readers[2];
+    std::vector<T*> m_retired[2];
+};
+
+#endif // RCUPOINTER_H
@@ -0,0 +1,324 @@
+#include "RingAllreduce.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+// How long a rank keeps retrying to reach its right neighbour while the ring starts up
+const int connectTimeoutSeconds = 60;
+
+std::runtime_error socketError(const std::string& what) {
+    return std::runtime_error("RingAllreduce: " + what + ": " + std::strerror(errno));
+}
+
+void configureSocket(int fd) {
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+}
+
+// Function to connect to host:port, retrying until the peer listens or the timeout expires
+int connectWithRetry(const std::string& host, int port) {
+    addrinfo hints;
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* address = nullptr;
+    if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &address) != 0 || address == nullptr) {
+        throw std::runtime_error("RingAllreduce: cannot resolve host " + host);
+    }
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(connectTimeoutSeconds);
+    for (;;) {
+        int fd = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+        if (fd < 0) {
+            freeaddrinfo(address);
+            throw socketError("socket");
+        }
+        if (connect(fd, address->ai_addr, address->ai_addrlen) == 0) {
+            freeaddrinfo(address);
+            return fd;
+        }
+        close(fd);
+        if (std::chrono::steady_clock::now() > deadline) {
+            freeaddrinfo(address);
+            throw socketError("connect to " + host + ":" + std::to_string(port));
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+}
+
+// Function to introduce this rank to the neighbour it just connected to
+void sendRank(int fd, int rank) {
+    int32_t value = rank;
+    if (send(fd, &value, sizeof(value), MSG_NOSIGNAL) != static_cast<ssize_t>(sizeof(value))) {
+        throw socketError("send rank");
+    }
+}
+
+// Function to wait until fd is readable; false if the deadline passes first
+bool waitReadable(int fd, std::chrono::steady_clock::time_point deadline) {
+    for (;;) {
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+        if (left.count() <= 0) {
+            return false;
+        }
+        pollfd entry = { fd, POLLIN, 0 };
+        int ready = poll(&entry, 1, static_cast<int>(left.count()));
+        if (ready > 0) {
+            return true;
+        }
+        if (ready < 0 && errno != EINTR) {
+            throw socketError("poll");
+        }
+    }
+}
+
+// Function to accept the connection of the left neighbour within the timeout. Connections
+// that do not introduce themselves as expectedRank (e.g. from a stale run) are dropped.
+int acceptRank(int listener, int expectedRank) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(connectTimeoutSeconds);
+    for (;;) {
+        if (!waitReadable(listener, deadline)) {
+            throw std::runtime_error("RingAllreduce: rank " + std::to_string(expectedRank) + " did not connect in time");
+        }
+        int fd = accept(listener, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            throw socketError("accept");
+        }
+        int32_t rank = -1;
+        if (waitReadable(fd, deadline) && recv(fd, &rank, sizeof(rank), MSG_WAITALL) == sizeof(rank) &&
+            rank == expectedRank) {
+            return fd;
+        }
+        close(fd);
+    }
+}
+
+} // namespace
+
+/**
+ * @brief Joins the ring; blocks until both neighbours are connected.
+ *
+ * Each rank sends its rank to the right neighbour after connecting, so a rank
+ * only accepts a connection from the rank to its left.
+ *
+ * @param rank The index of this process in hosts.
+ * @param hosts The host of every rank, in ring order.
+ * @param basePort Rank r listens on basePort + r.
+ * @throws std::invalid_argument If rank is not an index of hosts.
+ * @throws std::runtime_error If a socket cannot be set up or a neighbour does not show up in time.
+ */
+RingAllreduce::RingAllreduce(int rank, const std::vector<std::string>& hosts, int basePort)
+    : m_rank(rank), m_worldSize(static_cast<int>(hosts.size())), m_sendSocket(-1), m_receiveSocket(-1),
+    m_communicationSeconds(0.0) {
+    if (rank < 0 || rank >= m_worldSize) {
+        throw std::invalid_argument("RingAllreduce: rank out of range");
+    }
+    if (m_worldSize == 1) {
+        return;
+    }
+
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    if (listener < 0) {
+        throw socketError("socket");
+    }
+    int one = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in local;
+    std::memset(&local, 0, sizeof(local));
+    local.sin_family = AF_INET;
+    local.sin_addr.s_addr = htonl(INADDR_ANY);
+    local.sin_port = htons(static_cast<uint16_t>(basePort + rank));
+    if (bind(listener, reinterpret_cast<sockaddr*>(&local), sizeof(local)) != 0 || listen(listener, 1) != 0) {
+        close(listener);
+        throw socketError("listen on port " + std::to_string(basePort + rank));
+    }
+
+    // Connecting only needs the right neighbour to listen, so no rank waits on an accept first
+    const int right = (rank + 1) % m_worldSize;
+    const int left = (rank - 1 + m_worldSize) % m_worldSize;
+    try {
+        m_sendSocket = connectWithRetry(hosts[right], basePort + right);
+        sendRank(m_sendSocket, rank);
+        m_receiveSocket = acceptRank(listener, left);
+    } catch (...) {
+        close(listener);
+        if (m_sendSocket >= 0) {
+            close(m_sendSocket);
+        }
+        throw;
+    }
+    close(listener);
+    configureSocket(m_sendSocket);
+    configureSocket(m_receiveSocket);
+}
+
+RingAllreduce::~RingAllreduce() {
+    if (m_sendSocket >= 0) {
+        close(m_sendSocket);
+    }
+    if (m_receiveSocket >= 0) {
+        close(m_receiveSocket);
+    }
+}
+
+// Function to join the ring described by NN_RANK, NN_WORLD_SIZE, NN_PORT (default 29500)
+// and NN_HOSTS (comma-separated, default 127.0.0.1 for every rank)
+std::unique_ptr<RingAllreduce> RingAllreduce::fromEnvironment() {
+    const char* rankValue = std::getenv("NN_RANK");
+    const char* sizeValue = std::getenv("NN_WORLD_SIZE");
+    const char* portValue = std::getenv("NN_PORT");
+    const char* hostsValue = std::getenv("NN_HOSTS");
+    if (rankValue == nullptr || sizeValue == nullptr) {
+        throw std::runtime_error("RingAllreduce: NN_RANK and NN_WORLD_SIZE must be set");
+    }
+    int worldSize = std::atoi(sizeValue);
+    std::vector<std::string> hosts;
+    if (hostsValue != nullptr) {
+        std::stringstream stream(hostsValue);
+        std::string host;
+        while (std::getline(stream, host, ',')) {
+            hosts.push_back(host);
+        }
+    } else {
+        hosts.assign(std::max(worldSize, 0), "127.0.0.1");
+    }
+    if (static_cast<int>(hosts.size()) != worldSize) {
+        throw std::runtime_error("RingAllreduce: NN_HOSTS must list NN_WORLD_SIZE hosts");
+    }
+    return std::unique_ptr<RingAllreduce>(
+        new RingAllreduce(std::atoi(rankValue), hosts, portValue != nullptr ? std::atoi(portValue) : 29500));
+}
+
+int RingAllreduce::rank() const {
+    return m_rank;
+}
+
+int RingAllreduce::worldSize() const {
+    return m_worldSize;
+}
+
+// Function to get the wall time spent inside allreduce() and broadcast() so far
+double RingAllreduce::communicationSeconds() const {
+    return m_communicationSeconds;
+}
+
+/**
+ * @brief Replaces data on every rank by its element-wise sum over all ranks.
+ *
+ * All ranks must call it with the same count. The chunks are summed in ring
+ * order, so the result does not depend on timing.
+ *
+ * @param data The buffer to reduce, overwritten with the sum.
+ * @param count The number of elements in data.
+ */
+void RingAllreduce::allreduce(double* data, std::size_t count) {
+    if (m_worldSize == 1 || count == 0) {
+        return;
+    }
+    auto start = std::chrono::steady_clock::now();
+    const std::size_t n = static_cast<std::size_t>(m_worldSize);
+    auto chunkBegin = [&](std::size_t chunk) { return count * chunk / n; };
+    auto chunkSize = [&](std::size_t chunk) { return chunkBegin(chunk + 1) - chunkBegin(chunk); };
+    m_scratch.resize(count / n + 1);
+
+    // Reduce-scatter: after step s, chunk (rank - s - 1) holds the sum over s + 2 ranks
+    for (int step = 0; step < m_worldSize - 1; ++step) {
+        std::size_t sendChunk = static_cast<std::size_t>(m_rank - step + m_worldSize) % n;
+        std::size_t receiveChunk = static_cast<std::size_t>(m_rank - step - 1 + 2 * m_worldSize) % n;
+        exchange(data + chunkBegin(sendChunk), chunkSize(sendChunk), m_scratch.data(), chunkSize(receiveChunk));
+        double* target = data + chunkBegin(receiveChunk);
+        for (std::size_t i = 0; i < chunkSize(receiveChunk); ++i) {
+            target[i] += m_scratch[i];
+        }
+    }
+
+    // All-gather: pass the completed chunks once around the ring
+    for (int step = 0; step < m_worldSize - 1; ++step) {
+        std::size_t sendChunk = static_cast<std::size_t>(m_rank + 1 - step + m_worldSize) % n;
+        std::size_t receiveChunk = static_cast<std::size_t>(m_rank - step + m_worldSize) % n;
+        exchange(data + chunkBegin(sendChunk), chunkSize(sendChunk), data + chunkBegin(receiveChunk),
+                 chunkSize(receiveChunk));
+    }
+    m_communicationSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Function to copy the root's buffer to every rank
+void RingAllreduce::broadcast(double* data, std::size_t count, int root) {
+    if (m_rank != root) {
+        std::fill(data, data + count, 0.0);
+    }
+    allreduce(data, count);
+}
+
+// Function to send to the right neighbour while receiving from the left one. Both directions
+// progress together, so no rank blocks on a full socket buffer while its neighbour does the same.
+void RingAllreduce::exchange(const double* sendData, std::size_t sendCount, double* receiveData, std::size_t receiveCount) {
+    const char* sendBytes = reinterpret_cast<const char*>(sendData);
+    char* receiveBytes = reinterpret_cast<char*>(receiveData);
+    std::size_t sendLeft = sendCount * sizeof(double);
+    std::size_t receiveLeft = receiveCount * sizeof(double);
+
+    while (sendLeft > 0 || receiveLeft > 0) {
+        pollfd fds[2];
+        int numFds = 0;
+        if (sendLeft > 0) {
+            fds[numFds++] = { m_sendSocket, POLLOUT, 0 };
+        }
+        if (receiveLeft > 0) {
+            fds[numFds++] = { m_receiveSocket, POLLIN, 0 };
+        }
+        if (poll(fds, numFds, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw socketError("poll");
+        }
+        for (int f = 0; f < numFds; ++f) {
+            if (fds[f].revents & (POLLERR | POLLNVAL)) {
+                throw std::runtime_error("RingAllreduce: connection to a neighbour failed");
+            }
+            if (fds[f].fd == m_sendSocket && (fds[f].revents & POLLOUT)) {
+                ssize_t sent = send(m_sendSocket, sendBytes, sendLeft, MSG_NOSIGNAL);
+                if (sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                    throw socketError("send");
+                }
+                if (sent > 0) {
+                    sendBytes += sent;
+                    sendLeft -= static_cast<std::size_t>(sent);
+                }
+            }
+            if (fds[f].fd == m_receiveSocket && (fds[f].revents & (POLLIN | POLLHUP))) {
+                ssize_t received = recv(m_receiveSocket, receiveBytes, receiveLeft, 0);
+                if (received == 0) {
+                    throw std::runtime_error("RingAllreduce: left neighbour closed the connection");
+                }
+                if (received < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                    throw socketError("recv");
+                }
+                if (received > 0) {
+                    receiveBytes += received;
+                    receiveLeft -= static_cast<std::size_t>(received);
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,50 @@
+#ifndef RINGALLREDUCE_H
+#define RINGALLREDUCE_H
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Sums buffers across worker processes with a ring allreduce over TCP.
+ *
+ * Every rank keeps two connections: one to its right neighbour, which it
+ * sends to, and one from its left neighbour, which it receives from. A buffer
+ * is cut into worldSize chunks; worldSize - 1 reduce-scatter steps leave every
+ * rank with the full sum of one chunk, and worldSize - 1 all-gather steps
+ * circulate the summed chunks. Each rank sends and receives
+ * 2 * (worldSize - 1) / worldSize times the buffer per call, independent of the
+ * number of ranks, and every rank ends with bit-identical results.
+ *
+ * Rank r listens on basePort + r. With all hosts on 127.0.0.1 the whole ring
+ * runs on one machine; listing other hosts spans machines.
+ */
+class RingAllreduce {
+public:
+    RingAllreduce(int rank, const std::vector<std::string>& hosts, int basePort);
+    ~RingAllreduce();
+
+    RingAllreduce(const RingAllreduce&) = delete;
+    RingAllreduce& operator=(const RingAllreduce&) = delete;
+
+    static std::unique_ptr<RingAllreduce> fromEnvironment();
+
+    int rank() const;
+    int worldSize() const;
+    void allreduce(double* data, std::size_t count);
+    void broadcast(double* data, std::size_t count, int root = 0);
+    double communicationSeconds() const;
+
+private:
+    int m_rank;
+    int m_worldSize;
+    int m_sendSocket;
+    int m_receiveSocket;
+    double m_communicationSeconds;
+    std::vector<double> m_scratch;
+
+    void exchange(const double* sendData, std::size_t sendCount, double* receiveData, std::size_t receiveCount);
+};
+
+#endif // RINGALLREDUCE_H
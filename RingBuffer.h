@@ -0,0 +1,72 @@
+#ifndef RINGBUFFER_H
+#define RINGBUFFER_H
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+/**
+ * @brief A bounded single-producer, single-consumer queue without locks.
+ *
+ * The producer never waits: push() on a full buffer drops the record and counts
+ * it, so a consumer that polls rarely can never slow the producer down. Head
+ * and tail live on separate cache lines and each is written by one side only;
+ * a record is published by a release store of the head and claimed by an
+ * acquire load on the other side.
+ *
+ * push() must only be called from one thread at a time, and so must poll().
+ */
+template <typename T>
+class RingBuffer {
+public:
+    // The capacity is rounded up to a power of two
+    explicit RingBuffer(std::size_t capacity = 4096) : m_head(0), m_tail(0), m_dropped(0) {
+        std::size_t size = 1;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        m_records.resize(size);
+        m_mask = size - 1;
+    }
+
+    RingBuffer(const RingBuffer&) = delete;
+    RingBuffer& operator=(const RingBuffer&) = delete;
+
+    // Function to append a record; returns false and counts a drop when the buffer is full
+    bool push(const T& record) {
+        std::size_t head = m_head.load(std::memory_order_relaxed);
+        if (head - m_tail.load(std::memory_order_acquire) > m_mask) {
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        m_records[head & m_mask] = record;
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Function to move up to maxCount of the oldest records to the end of out; returns how many were moved
+    std::size_t poll(std::vector<T>& out, std::size_t maxCount = static_cast<std::size_t>(-1)) {
+        std::size_t tail = m_tail.load(std::memory_order_relaxed);
+        std::size_t head = m_head.load(std::memory_order_acquire);
+        std::size_t count = head - tail < maxCount ? head - tail : maxCount;
+        for (std::size_t i = 0; i < count; ++i) {
+            out.push_back(m_records[(tail + i) & m_mask]);
+        }
+        m_tail.store(tail + count, std::memory_order_release);
+        return count;
+    }
+
+    // Function to get the number of records dropped because the buffer was full
+    long long dropped() const {
+        return m_dropped.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::vector<T> m_records;
+    std::size_t m_mask;
+    alignas(64) std::atomic<std::size_t> m_head;
+    alignas(64) std::atomic<std::size_t> m_tail;
+    alignas(64) std::atomic<long long> m_dropped;
+};
+
+#endif // RINGBUFFER_H
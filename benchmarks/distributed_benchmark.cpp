@@ -0,0 +1,119 @@
+// Scaling benchmark of data-parallel training with 1..N worker processes on localhost.
+//
+// Every run trains the same 784-128-47 network on the same synthetic dataset with a
+// fixed global batch size; each worker gets the same number of OpenMP threads, so
+// adding a worker adds compute. For every worker count it reports the training
+// throughput, the speedup over one worker, the parallel efficiency (speedup divided
+// by workers), the efficiency of the last added worker (throughput gained relative
+// to what one worker delivers) and the share of time spent in the ring allreduce.
+//
+// Usage: distributed_benchmark [max workers] [samples] [epochs] [batch size]
+
+#include "../DistributedTrainer.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+namespace {
+
+struct RunResult {
+    double seconds = 0.0;
+    double communicationSeconds = 0.0;
+    double error = 0.0;
+};
+
+// Noisy copies of one random prototype per class, like a small EMNIST
+void makeDataset(int samples, std::vector<std::vector<double>>& inputs, std::vector<int>& labels) {
+    const int classes = 47;
+    std::mt19937 generator(42);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    std::vector<std::vector<double>> prototypes(classes, std::vector<double>(784));
+    for (std::vector<double>& prototype : prototypes) {
+        for (double& value : prototype) {
+            value = uniform(generator) < 0.2 ? uniform(generator) : 0.0;
+        }
+    }
+    inputs.assign(samples, std::vector<double>(784));
+    labels.resize(samples);
+    for (int i = 0; i < samples; ++i) {
+        labels[i] = static_cast<int>(generator() % classes);
+        for (int j = 0; j < 784; ++j) {
+            double noise = (uniform(generator) - 0.5) * 0.4;
+            inputs[i][j] = std::min(1.0, std::max(0.0, prototypes[labels[i]][j] + noise));
+        }
+    }
+}
+
+RunResult runWorkers(int workers, int threads, const std::vector<std::vector<double>>& inputs,
+                     const std::vector<int>& labels, int epochs, int batchSize) {
+    int channel[2];
+    if (pipe(channel) != 0) {
+        std::perror("pipe");
+        std::exit(1);
+    }
+    DistributedTrainer::launchLocal(workers, 29500 + 64 * workers, [&](RingAllreduce& communicator) {
+        NeuralNetwork network({ 784, 128, 47 }, 0.01);
+        network.setLossFunction(LossFunction::SoftmaxCrossEntropy);
+        OptimizerConfig config;
+        config.type = OptimizerType::Adam;
+        config.learningRate = 0.001;
+        network.setOptimizer(config);
+        network.setNumThreads(threads);
+
+        DistributedTrainer trainer(network, communicator);
+        auto start = std::chrono::steady_clock::now();
+        double error = trainer.train(inputs, labels, epochs, batchSize);
+        RunResult result;
+        result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        result.communicationSeconds = communicator.communicationSeconds();
+        result.error = error;
+        if (communicator.rank() == 0 && write(channel[1], &result, sizeof(result)) != sizeof(result)) {
+            std::perror("write");
+        }
+    });
+    RunResult result;
+    if (read(channel[0], &result, sizeof(result)) != sizeof(result)) {
+        std::perror("read");
+    }
+    close(channel[0]);
+    close(channel[1]);
+    return result;
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    int maxWorkers = argc > 1 ? std::atoi(argv[1]) : 4;
+    int samples = argc > 2 ? std::atoi(argv[2]) : 20000;
+    int epochs = argc > 3 ? std::atoi(argv[3]) : 2;
+    int batchSize = argc > 4 ? std::atoi(argv[4]) : 256;
+    int threads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()) / std::max(maxWorkers, 1));
+
+    std::vector<std::vector<double>> inputs;
+    std::vector<int> labels;
+    makeDataset(samples, inputs, labels);
+    std::printf("%d samples, %d epochs, global batch %d, %d threads per worker\n", samples, epochs, batchSize, threads);
+    std::printf("workers  samples/s  speedup  efficiency  added-worker  allreduce  final loss\n");
+
+    double baseline = 0.0;
+    double previous = 0.0;
+    for (int workers = 1; workers <= maxWorkers; ++workers) {
+        RunResult result = runWorkers(workers, threads, inputs, labels, epochs, batchSize);
+        double throughput = static_cast<double>(samples) * epochs / result.seconds;
+        if (workers == 1) {
+            baseline = throughput;
+        }
+        double speedup = throughput / baseline;
+        double added = workers == 1 ? 1.0 : (throughput - previous) / baseline;
+        std::printf("%7d  %9.0f  %6.2fx  %9.1f%%  %11.1f%%  %8.1f%%  %10.4f\n", workers, throughput, speedup,
+                    100.0 * speedup / workers, 100.0 * added, 100.0 * result.communicationSeconds / result.seconds,
+                    result.error);
+        previous = throughput;
+    }
+    return 0;
+}
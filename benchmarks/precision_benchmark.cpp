@@ -0,0 +1,99 @@
+// Benchmark of the dense-layer forward kernels in double, bfloat16 and fp16 storage.
+//
+// For every precision it reports the time per sample, the number of weight bytes
+// streamed per sample and the resulting effective weight bandwidth. The EMNIST
+// shape (784-128-47) mostly lives in cache; the wide shape does not, which is
+// where the 16-bit copies pay off. fp16 is only measured on CPUs with F16C.
+//
+// Usage: precision_benchmark [samples]
+
+#include "../Layer.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+namespace {
+
+const char* precisionName(Precision precision) {
+    switch (precision) {
+    case Precision::BFloat16:
+        return "bfloat16";
+    case Precision::Float16:
+        return "float16";
+    default:
+        return "double";
+    }
+}
+
+double bytesPerWeight(Precision precision) {
+    return precision == Precision::Double ? sizeof(double) : sizeof(uint16_t);
+}
+
+void runShape(const std::vector<int>& sizes, int samples) {
+    std::mt19937 generator(42);
+    std::uniform_real_distribution<double> pixel(0.0, 1.0);
+    std::vector<double> inputs(static_cast<size_t>(samples) * sizes[0]);
+    for (double& value : inputs) {
+        value = pixel(generator);
+    }
+
+    std::printf("shape");
+    for (int size : sizes) {
+        std::printf(" %d", size);
+    }
+    std::printf(", %d samples\n", samples);
+
+    const Precision precisions[] = { Precision::Double, Precision::BFloat16, Precision::Float16 };
+    double baseline = 0.0;
+    for (Precision precision : precisions) {
+        if (precision == Precision::Float16 && !hasHardwareFloat16()) {
+            std::printf("  %-9s skipped: this CPU has no F16C\n", precisionName(precision));
+            continue;
+        }
+        std::vector<DenseLayer> layers;
+        long long weightCount = 0;
+        int widest = 0;
+        for (size_t l = 1; l < sizes.size(); ++l) {
+            layers.emplace_back(sizes[l - 1], sizes[l]);
+            layers.back().randomize(-0.1, 0.1);
+            layers.back().setStoragePrecision(precision);
+            weightCount += static_cast<long long>(sizes[l - 1]) * sizes[l];
+            widest = std::max(widest, sizes[l]);
+        }
+        std::vector<double> current(widest);
+        std::vector<double> next(widest);
+        double checksum = 0.0;
+
+        auto start = std::chrono::steady_clock::now();
+        for (int s = 0; s < samples; ++s) {
+            const double* input = inputs.data() + static_cast<size_t>(s) * sizes[0];
+            for (const DenseLayer& layer : layers) {
+                layer.forward(input, next.data());
+                current.swap(next);
+                input = current.data();
+            }
+            checksum += input[0];
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        double bytes = weightCount * bytesPerWeight(precision);
+        double perSample = seconds / samples;
+        if (precision == Precision::Double) {
+            baseline = perSample;
+        }
+        std::printf("  %-9s %9.2f us/sample  %8.1f KiB weights/sample  %7.2f GB/s  speedup %.2fx  (checksum %.4f)\n",
+                    precisionName(precision), perSample * 1e6, bytes / 1024.0, bytes / perSample / 1e9,
+                    baseline / perSample, checksum);
+    }
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    int samples = argc > 1 ? std::atoi(argv[1]) : 2000;
+    runShape({ 784, 128, 47 }, samples);
+    runShape({ 784, 4096, 4096, 47 }, std::max(1, samples / 50));
+    return 0;
+}
@@ -29,6 +29,8 @@ private:
     std::vector<int> testLabels;
     void test_suite(NeuralNetwork& nn, std::vector<std::vector<double>>& inputs, std::vector<int>& labels, int& results);
     TrainModelWorker* worker;
+    static const int trainingEpochs = 20;
+    static constexpr const char* checkpointFile = "training_checkpoint.bin";
     bool isTraining;
     bool isTestingPeriodically;
     int testingIndex;
@@ -44,6 +46,7 @@ private slots:
     void loadModel();
     void onTrainingCompleted(QString message);
     void stopTraining();
+    void pauseTraining();
     void updateTrainingProgress(int epoch);
     void updateErrorGraph(double error);
 };
@@ -8,7 +8,8 @@ class TrainModelWorker : public QThread {
     Q_OBJECT
 
 public:
-    TrainModelWorker(NeuralNetwork* nn, const std::vector<std::vector<double>>& data, const std::vector<int>& labels);
+    TrainModelWorker(NeuralNetwork* nn, const std::vector<std::vector<double>>& data, const std::vector<int>& labels,
+                     int epochs = 100, int batchSize = 32);
 signals:
     void trainingProgressUpdate(const QString& message);
     void trainingCompleted(QString message);
@@ -22,6 +23,8 @@ private:
     NeuralNetwork* neuralNetwork;
     std::vector<std::vector<double>> trainingData;   // Remove the reference and const qualifiers
     std::vector<int> trainingLabels;                 // Remove the reference and const qualifiers
+    int epochs;
+    int batchSize;
 };
 
 #endif // TRAINMODELWORKER_H